@@ -27,7 +27,7 @@
 
 
 # Specification in the form of a command-line invocation:
-#   gnulib-tool --import --dir=. --lib=libgnu --source-base=lib --m4-base=m4 --doc-base=doc --tests-base=tests --aux-dir=build-aux --conditional-dependencies --no-libtool --macro-prefix=gl --no-vc-files _Exit closedir dirent double-slash-root errno extensions fcntl fcntl-h findprog fstat getcwd getlogin_r getopt-gnu git-version-gen hash-pjw inline largefile mkstemp obstack obstack-printf open opendir progname readlink same-inode sigaction signal snippet/_Noreturn snippet/unused-parameter snprintf sprintf-posix ssize_t stat stdarg stdbool stdint stdio stdlib string strsignal sys_stat sys_wait time time_r tzset unistd unistd-safer waitpid
+#   gnulib-tool --import --dir=. --lib=libgnu --source-base=lib --m4-base=m4 --doc-base=doc --tests-base=tests --aux-dir=build-aux --conditional-dependencies --no-libtool --macro-prefix=gl --no-vc-files _Exit closedir dirent double-slash-root errno extensions fcntl fcntl-h findprog fstat getcwd getlogin_r getopt-gnu git-version-gen hash-pjw inline largefile mkstemp obstack obstack-printf open opendir progname readlink same-inode sigaction signal snippet/_Noreturn snippet/unused-parameter snprintf sprintf-posix ssize_t stat stat-time stdarg stdbool stdint stdio stdlib string strsignal sys_stat sys_wait time time_r tzset unistd unistd-safer waitpid
 
 # Specification in the form of a few gnulib-tool.m4 macro invocations:
 gl_LOCAL_DIR([])
@@ -45,6 +45,7 @@ gl_MODULES([
   getcwd
   getlogin_r
   getopt-gnu
+  gettime
   git-version-gen
   hash-pjw
   inline
@@ -65,6 +66,7 @@ gl_MODULES([
   sprintf-posix
   ssize_t
   stat
+  stat-time
   stdarg
   stdbool
   stdint
@@ -76,6 +78,7 @@ gl_MODULES([
   sys_wait
   time
   time_r
+  timespec
   tzset
   unistd
   unistd-safer
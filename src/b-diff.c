@@ -0,0 +1,692 @@
+/* b-diff.c --- built-in line diff, producing RCS edit scripts
+
+   Copyright (C) 2010-2012 Thien-Thi Nguyen
+
+   This file is part of GNU RCS.
+
+   GNU RCS is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU RCS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty
+   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+   See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base.h"
+#include <string.h>
+#include "b-divvy.h"
+#include "b-fb.h"
+#include "b-scan.h"
+#include "b-diff.h"
+
+/* This computes the same kind of edit script as "diff -n", without
+   running diff(1).  Lines are first reduced to small integers (their
+   equivalence class), so that comparing two lines is cheap.  The
+   common prefix and suffix are set aside, as is every line that does
+   not occur at all in the other text; such lines cannot be part of
+   any common subsequence, and they are usually the bulk of a change.
+   The remaining lines are compared with the linear-space variant of
+   the algorithm in E. Myers, "An O(ND) Difference Algorithm and Its
+   Variations", Algorithmica 1 (1986), 251-266.  As in diff(1), if
+   finding the middle snake is too expensive, we settle for the best
+   split point found so far, so that the result, while always correct,
+   is not necessarily minimal.  */
+
+struct side
+{
+  size_t count;
+  /* Number of lines.  */
+
+  char const **beg;
+  /* Start of each line; ‘beg[count]’ is the end of the text.  */
+
+  size_t *class;
+  /* Equivalence class of each line.  */
+
+  bool *changed;
+  /* Whether each line is part of the edit script.  */
+
+  size_t rcount;
+  size_t *rclass;
+  size_t *rindex;
+  /* The lines left for ‘compare’: their number, class,
+     and index in the vectors above.  */
+};
+
+struct diffctx
+{
+  struct side *old, *new;
+
+  long *fd, *bd;
+  /* Furthest-reaching forward and backward paths, indexed by
+     diagonal (line number in ‘old’ minus line number in ‘new’).  */
+
+  long maxcost;
+  /* After this many rounds, ‘middle_snake’ gives up on minimality.  */
+};
+
+#define LEN(s,i)  ((size_t) ((s)->beg[(i) + 1] - (s)->beg[i]))
+
+static bool
+same_line (struct side const *s, size_t i, struct side const *t, size_t j)
+{
+  size_t len = LEN (s, i);
+
+  return len == LEN (t, j) && MEM_SAME (len, s->beg[i], t->beg[j]);
+}
+
+void
+diff_split (struct divvy *space, struct cbuf text, struct difflines *dl)
+/* Set up ‘dl’ for ‘text’, with no line marked as changed,
+   allocating its vectors in ‘space’.  */
+{
+  char const *p = text.string, *lim = p + text.size;
+  char const *nl;
+  size_t n = 0;
+
+  for (char const *q = p; q < lim; q = nl + 1)
+    {
+      n++;
+      if (!(nl = memchr (q, '\n', lim - q)))
+        break;
+    }
+  dl->count = n;
+  dl->beg = alloc (space, "beg", (n + 1) * sizeof (char const *));
+  for (size_t i = 0; i < n; i++)
+    {
+      dl->beg[i] = p;
+      p = (nl = memchr (p, '\n', lim - p))
+        ? nl + 1
+        : lim;
+    }
+  dl->beg[n] = lim;
+  /* Leave room for a (false) sentinel at each end.  */
+  dl->changed = 1 + (bool *) zlloc (space, "changed",
+                                    (n + 2) * sizeof (bool));
+}
+
+static void
+split_lines (struct divvy *space, struct divvy *scratch,
+             struct side *s, struct cbuf text)
+/* Set up ‘s’ for ‘text’, allocating the vectors that outlive the
+   comparison (‘beg’, ‘changed’) in ‘space’, and the rest in ‘scratch’.  */
+{
+  struct difflines dl;
+  size_t n;
+
+  diff_split (space, text, &dl);
+  n = s->count = dl.count;
+  s->beg = dl.beg;
+  s->changed = dl.changed;
+  s->class = alloc (scratch, "class", n * sizeof (size_t));
+  s->rclass = alloc (scratch, "rclass", n * sizeof (size_t));
+  s->rindex = alloc (scratch, "rindex", n * sizeof (size_t));
+  s->rcount = 0;
+}
+
+static size_t
+line_hash (char const *p, size_t len)
+{
+  uint64_t h = len, w;
+
+  /* Take eight bytes at a time.  */
+  for (; 8 <= len; p += 8, len -= 8)
+    {
+      memcpy (&w, p, 8);
+      h = (h ^ w) * UINT64_C (0x9e3779b97f4a7c15);
+    }
+  for (w = 0; len; len--)
+    w = (w << 8) | (unsigned char) *p++;
+  h = (h ^ w) * UINT64_C (0x9e3779b97f4a7c15);
+  /* Mix the high bits into the low ones, which index the table.  */
+  return h ^ (h >> 29) ^ (h >> 47);
+}
+
+static size_t *
+classify (struct divvy *space, struct side *old, struct side *new,
+          size_t pre, size_t suf)
+/* Set the ‘class’ of each line of ‘old’ and ‘new’ between the common
+   prefix of length ‘pre’ and the common suffix of length ‘suf’, such
+   that two lines have the same class iff they have the same bytes.
+   Return a vector, indexed by class, of the number of occurrences
+   in ‘old’.  */
+{
+  size_t total = old->count + new->count - 2 * (pre + suf);
+  size_t size = 16, mask, count = 0;
+  size_t *slot, *hash, *rep, *in_old;
+
+  /* Keep the table small (load factor up to 3/4), since for big
+     texts, the cost is mostly in cache misses on it.  */
+  while (size < total + total / 3)
+    size <<= 1;
+  mask = size - 1;
+  /* A slot holds a class plus 1, or 0 if it is empty.  */
+  slot = zlloc (space, "slot", size * sizeof (size_t));
+  hash = alloc (space, "hash", (total + 1) * sizeof (size_t));
+  /* A class is represented by its first line, which is in ‘old’
+     if its index is less than ‘old->count’, else in ‘new’.  */
+  rep = alloc (space, "rep", (total + 1) * sizeof (size_t));
+  in_old = zlloc (space, "in_old", (total + 1) * sizeof (size_t));
+
+  for (struct side *s = old; s; s = (s == old ? new : NULL))
+    for (size_t i = pre, guess = old->count; i < s->count - suf; i++)
+      {
+        size_t h, j, c;
+
+        /* Most lines of ‘new’ are also in ‘old’, in the same order.
+           Try the line after the one that matched last time, before
+           going to the table (whose size makes it slow to access).  */
+        if (guess < old->count - suf && same_line (s, i, old, guess))
+          {
+            s->class[i] = old->class[guess++];
+            continue;
+          }
+
+        h = line_hash (s->beg[i], LEN (s, i));
+
+        for (j = h & mask; (c = slot[j]); j = (j + 1) & mask)
+          if (h == hash[c - 1]
+              && (rep[c - 1] < old->count
+                  ? same_line (s, i, old, rep[c - 1])
+                  : same_line (s, i, new, rep[c - 1] - old->count)))
+            break;
+        if (!c)
+          {
+            c = slot[j] = ++count;
+            hash[c - 1] = h;
+            rep[c - 1] = i + (s == old ? 0 : old->count);
+          }
+        s->class[i] = c - 1;
+        if (s == old)
+          in_old[c - 1]++;
+        else if (rep[c - 1] < old->count)
+          guess = 1 + rep[c - 1];
+      }
+  return in_old;
+}
+
+static void
+middle_snake (struct diffctx *ctx, long off1, long lim1, long off2, long lim2,
+              long *mid1, long *mid2)
+/* Find the midpoint of the shortest edit script for ‘old’ lines
+   [off1,lim1) and ‘new’ lines [off2,lim2) (or, if that is too
+   expensive, a reasonable split point), and set ‘*mid1’ and ‘*mid2’
+   to it.  The ranges must be non-empty and differ at both ends.  */
+{
+  size_t const *a = ctx->old->rclass, *b = ctx->new->rclass;
+  long *fd = ctx->fd, *bd = ctx->bd;
+  long dmin = off1 - lim2, dmax = lim1 - off2;
+  long fmid = off1 - off2, bmid = lim1 - lim2;
+  bool odd = (fmid - bmid) & 1;
+  long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+  long d, i1, i2;
+
+  fd[fmid] = off1;
+  bd[bmid] = lim1;
+  for (long cost = 1;; cost++)
+    {
+      /* Extend the forward search by one edit.  */
+      if (fmin > dmin)
+        fd[--fmin - 1] = -1;
+      else
+        ++fmin;
+      if (fmax < dmax)
+        fd[++fmax + 1] = -1;
+      else
+        --fmax;
+      for (d = fmax; d >= fmin; d -= 2)
+        {
+          i1 = fd[d - 1] >= fd[d + 1]
+            ? fd[d - 1] + 1
+            : fd[d + 1];
+          i2 = i1 - d;
+          while (i1 < lim1 && i2 < lim2 && a[i1] == b[i2])
+            i1++, i2++;
+          fd[d] = i1;
+          if (odd && bmin <= d && d <= bmax && bd[d] <= i1)
+            {
+              *mid1 = i1;
+              *mid2 = i2;
+              return;
+            }
+        }
+
+      /* Extend the backward search by one edit.  */
+      if (bmin > dmin)
+        bd[--bmin - 1] = LONG_MAX;
+      else
+        ++bmin;
+      if (bmax < dmax)
+        bd[++bmax + 1] = LONG_MAX;
+      else
+        --bmax;
+      for (d = bmax; d >= bmin; d -= 2)
+        {
+          i1 = bd[d - 1] < bd[d + 1]
+            ? bd[d - 1]
+            : bd[d + 1] - 1;
+          i2 = i1 - d;
+          while (i1 > off1 && i2 > off2 && a[i1 - 1] == b[i2 - 1])
+            i1--, i2--;
+          bd[d] = i1;
+          if (!odd && fmin <= d && d <= fmax && i1 <= fd[d])
+            {
+              *mid1 = i1;
+              *mid2 = i2;
+              return;
+            }
+        }
+
+      if (cost >= ctx->maxcost)
+        {
+          /* Too expensive.  Take the path (forward or backward)
+             that has come the furthest.  */
+          long fbest = -1, fbest1 = -1;
+          long bbest = LONG_MAX, bbest1 = LONG_MAX;
+
+          for (d = fmax; d >= fmin; d -= 2)
+            {
+              i1 = fd[d] < lim1 ? fd[d] : lim1;
+              i2 = i1 - d;
+              if (lim2 < i2)
+                i1 = lim2 + d, i2 = lim2;
+              if (fbest < i1 + i2)
+                fbest = i1 + i2, fbest1 = i1;
+            }
+          for (d = bmax; d >= bmin; d -= 2)
+            {
+              i1 = bd[d] > off1 ? bd[d] : off1;
+              i2 = i1 - d;
+              if (i2 < off2)
+                i1 = off2 + d, i2 = off2;
+              if (i1 + i2 < bbest)
+                bbest = i1 + i2, bbest1 = i1;
+            }
+          if ((lim1 + lim2) - bbest < fbest - (off1 + off2))
+            {
+              *mid1 = fbest1;
+              *mid2 = fbest - fbest1;
+            }
+          else
+            {
+              *mid1 = bbest1;
+              *mid2 = bbest - bbest1;
+            }
+          return;
+        }
+    }
+}
+
+static void
+compare (struct diffctx *ctx, long off1, long lim1, long off2, long lim2)
+/* Mark as changed the lines of ‘old’ [off1,lim1) and ‘new’ [off2,lim2)
+   that are not part of their common subsequence.  */
+{
+  struct side *old = ctx->old, *new = ctx->new;
+  size_t const *a = old->rclass, *b = new->rclass;
+
+  while (off1 < lim1 && off2 < lim2 && a[off1] == b[off2])
+    off1++, off2++;
+  while (off1 < lim1 && off2 < lim2 && a[lim1 - 1] == b[lim2 - 1])
+    lim1--, lim2--;
+
+  if (off1 == lim1)
+    while (off2 < lim2)
+      new->changed[new->rindex[off2++]] = true;
+  else if (off2 == lim2)
+    while (off1 < lim1)
+      old->changed[old->rindex[off1++]] = true;
+  else
+    {
+      long mid1, mid2;
+
+      middle_snake (ctx, off1, lim1, off2, lim2, &mid1, &mid2);
+      compare (ctx, off1, mid1, off2, mid2);
+      compare (ctx, mid1, lim1, mid2, lim2);
+    }
+}
+
+static void
+reduce (struct side *s, size_t pre, size_t suf, size_t const *other)
+/* Set up the lines of ‘s’ between the common prefix of length ‘pre’
+   and the common suffix of length ‘suf’ for ‘compare’, marking as
+   changed those whose ‘other’ count of occurrences is 0.  */
+{
+  for (size_t i = pre; i < s->count - suf; i++)
+    if (!other[s->class[i]])
+      s->changed[i] = true;
+    else
+      {
+        s->rclass[s->rcount] = s->class[i];
+        s->rindex[s->rcount++] = i;
+      }
+}
+
+static void
+shift_boundaries (struct side *s, struct side const *other)
+/* Move each run of changed lines in ‘s’ as far as it can go, to merge
+   it with neighboring runs, but then back to where it lines up with a
+   run of changes in ‘other’, if possible.  This does not change the
+   number of changed lines, only how they are grouped; it is the same
+   adjustment diff(1) does.  */
+{
+  bool *changed = s->changed;
+  bool const *other_changed = other->changed;
+  size_t i = 0, j = 0, i_end = s->count;
+
+  for (;;)
+    {
+      size_t runlength, start, corresponding;
+
+      /* Find the beginning of the next run of changes, keeping
+         track of the corresponding point in ‘other’.  */
+      while (i < i_end && !changed[i])
+        {
+          while (other_changed[j++])
+            continue;
+          i++;
+        }
+      if (i == i_end)
+        break;
+      start = i;
+
+      /* Find the end of this run.  */
+      while (changed[++i])
+        continue;
+      while (other_changed[j])
+        j++;
+
+      do
+        {
+          runlength = i - start;
+
+          /* Move the run back, so long as the previous unchanged line
+             matches the last changed one.  This merges with previous
+             runs.  */
+          while (start && same_line (s, start - 1, s, i - 1))
+            {
+              changed[--start] = true;
+              changed[--i] = false;
+              while (changed[start - 1])
+                start--;
+              while (other_changed[--j])
+                continue;
+            }
+
+          /* Note the last end of the run that lines up with
+             a run in ‘other’ (‘i_end’ means none).  */
+          corresponding = other_changed[j - 1] ? i : i_end;
+
+          /* Move the run forward, so long as the first changed line
+             matches the following unchanged one.  This merges with
+             following runs.  */
+          while (i != i_end && same_line (s, start, s, i))
+            {
+              changed[start++] = false;
+              changed[i++] = true;
+              while (changed[i])
+                i++;
+              while (other_changed[++j])
+                corresponding = i;
+            }
+        }
+      while (runlength != i - start);
+
+      /* Move the fully merged run back to line up with ‘other’.  */
+      while (corresponding < i)
+        {
+          changed[--start] = true;
+          changed[--i] = false;
+          while (other_changed[--j])
+            continue;
+        }
+    }
+}
+
+void
+diff_lines (struct divvy *space, struct cbuf old, struct cbuf new,
+            struct difflines *ol, struct difflines *nl)
+/* Compare ‘old’ and ‘new’ line by line, filling in ‘ol’ and ‘nl’,
+   respectively, with vectors allocated in ‘space’.  */
+{
+  struct divvy *scratch = make_space ("diff");
+  struct side o, n;
+  struct diffctx ctx = { .old = &o, .new = &n };
+  size_t *in_old, *in_new, pre, suf, i;
+  long ndiags;
+
+  split_lines (space, scratch, &o, old);
+  split_lines (space, scratch, &n, new);
+
+  /* Set aside the common prefix and suffix.  */
+  for (pre = 0;
+       pre < o.count && pre < n.count && same_line (&o, pre, &n, pre);
+       pre++)
+    continue;
+  for (suf = 0;
+       suf < o.count - pre && suf < n.count - pre
+         && same_line (&o, o.count - 1 - suf, &n, n.count - 1 - suf);
+       suf++)
+    continue;
+  in_old = classify (scratch, &o, &n, pre, suf);
+
+  /* Count the occurrences in ‘new’, for the other direction.  */
+  in_new = zlloc (scratch, "in_new",
+                  (o.count + n.count + 1) * sizeof (size_t));
+  for (i = pre; i < n.count - suf; i++)
+    in_new[n.class[i]]++;
+  reduce (&o, pre, suf, in_new);
+  reduce (&n, pre, suf, in_old);
+
+  ndiags = o.rcount + n.rcount + 3;
+  ctx.fd = (long *) alloc (scratch, "fd", ndiags * sizeof (long))
+    + n.rcount + 1;
+  ctx.bd = (long *) alloc (scratch, "bd", ndiags * sizeof (long))
+    + n.rcount + 1;
+  for (ctx.maxcost = 1; ctx.maxcost * ctx.maxcost < ndiags; ctx.maxcost <<= 1)
+    continue;
+  if (ctx.maxcost < 256)
+    ctx.maxcost = 256;
+  compare (&ctx, 0, o.rcount, 0, n.rcount);
+  shift_boundaries (&o, &n);
+  shift_boundaries (&n, &o);
+
+  ol->count = o.count;
+  ol->beg = o.beg;
+  ol->changed = o.changed;
+  nl->count = n.count;
+  nl->beg = n.beg;
+  nl->changed = n.changed;
+  close_space (scratch);
+}
+
+void
+diff_stuffed (FILE *to, struct cbuf old, struct cbuf new)
+/* Write to ‘to’ an edit script in the format of "diff -n" that turns
+   ‘old’ into ‘new’, doubling each ‘SDELIM’ in the added lines.  */
+{
+  struct divvy *space = make_space ("diff_stuffed");
+  struct difflines o, n;
+  size_t i, j;
+
+  diff_lines (space, old, new, &o, &n);
+
+  /* Walk both texts in step, writing a "d" command for each run of
+     changed lines in ‘old’ and an "a" command for each in ‘new’.  */
+  for (i = j = 0; i < o.count || j < n.count;)
+    {
+      size_t i0 = i, j0 = j;
+
+      while (i < o.count && o.changed[i])
+        i++;
+      while (j < n.count && n.changed[j])
+        j++;
+      if (i0 < i)
+        aprintf (to, "d%zu %zu\n", i0 + 1, i - i0);
+      if (j0 < j)
+        {
+          aprintf (to, "a%zu %zu\n", i, j - j0);
+          stuff_sdelim (to, n.beg[j0], n.beg[j] - n.beg[j0]);
+        }
+      if (i0 == i && j0 == j)
+        i++, j++;
+    }
+  close_space (space);
+}
+
+struct change
+{
+  size_t i0, i1;
+  /* Lines [i0,i1) of the old text are deleted...  */
+
+  size_t j0, j1;
+  /* ...and replaced by lines [j0,j1) of the new text.  */
+};
+
+static size_t
+changes (struct divvy *space, struct difflines const *ol,
+         struct difflines const *nl, struct change **rv)
+/* Set ‘*rv’ to a vector (allocated in ‘space’) of the runs of changed
+   lines in ‘ol’ and ‘nl’, and return its length.  */
+{
+  struct change *ch;
+  size_t n = 0, i, j;
+
+  /* There cannot be more runs than lines, plus one.  */
+  ch = alloc (space, "changes",
+              (ol->count + nl->count + 1) * sizeof (struct change));
+  for (i = j = 0; i < ol->count || j < nl->count;)
+    {
+      size_t i0 = i, j0 = j;
+
+      while (i < ol->count && ol->changed[i])
+        i++;
+      while (j < nl->count && nl->changed[j])
+        j++;
+      if (i0 < i || j0 < j)
+        ch[n++] = (struct change) { i0, i, j0, j };
+      else
+        i++, j++;
+    }
+  *rv = ch;
+  return n;
+}
+
+static void
+show_lines (FILE *to, char const *prefix, struct difflines const *d,
+            size_t beg, size_t end)
+/* Write lines [beg,end) of ‘d’ to ‘to’, each preceded by ‘prefix’.  */
+{
+  for (size_t i = beg; i < end; i++)
+    {
+      char const *p = d->beg[i], *lim = d->beg[i + 1];
+
+      aputs (prefix, to);
+      awrite (p, lim - p, to);
+      if ('\n' != lim[-1])
+        aputs ("\n\\ No newline at end of file\n", to);
+    }
+}
+
+static void
+show_normal_range (FILE *to, size_t beg, size_t end)
+/* Write lines [beg,end) as "diff" does: "N" for a single line
+   (or for the empty range after line N), else "N,M".  */
+{
+  if (1 < end - beg)
+    aprintf (to, "%zu,%zu", beg + 1, end);
+  else
+    aprintf (to, "%zu", end);
+}
+
+static void
+show_unified_range (FILE *to, size_t beg, size_t end)
+/* Write lines [beg,end) as "diff -u" does: "N" for a single line,
+   else "N,COUNT", where N is the line before an empty range.  */
+{
+  if (1 == end - beg)
+    aprintf (to, "%zu", end);
+  else
+    aprintf (to, "%zu,%zu", beg + (beg < end), end - beg);
+}
+
+bool
+diff_show (FILE *to, struct difflines const *ol, struct difflines const *nl,
+           long context, char const *label[2])
+/* Write to ‘to’ the differences between ‘ol’ and ‘nl’ (as marked by
+   ‘diff_lines’, for example) in the default format of diff(1) if
+   ‘context’ is negative, otherwise in its unified format, with
+   ‘context’ lines of context and ‘label’ naming the old and new text.
+   Return true if there are any differences.  */
+{
+  struct divvy *space = make_space ("diff_show");
+  struct change *ch;
+  size_t n = changes (space, ol, nl, &ch);
+
+  if (n && 0 > context)
+    for (size_t k = 0; k < n; k++)
+      {
+        struct change *c = ch + k;
+        int how = c->i0 == c->i1
+          ? 'a'
+          : (c->j0 == c->j1
+             ? 'd'
+             : 'c');
+
+        show_normal_range (to, c->i0, c->i1);
+        afputc (how, to);
+        show_normal_range (to, c->j0, c->j1);
+        afputc ('\n', to);
+        show_lines (to, "< ", ol, c->i0, c->i1);
+        if ('c' == how)
+          aputs ("---\n", to);
+        show_lines (to, "> ", nl, c->j0, c->j1);
+      }
+  else if (n)
+    {
+      size_t span = 2 * context;
+
+      aprintf (to, "--- %s\n+++ %s\n", label[0], label[1]);
+      for (size_t k = 0; k < n;)
+        {
+          struct change *first = ch + k, *last = first;
+          size_t obeg, oend, nbeg, nend, i;
+
+          /* Changes separated by no more than twice the context
+             share a hunk.  */
+          while (++k < n && ch[k].i0 - last->i1 <= span)
+            last = ch + k;
+          obeg = (size_t) context < first->i0
+            ? first->i0 - context
+            : 0;
+          nbeg = first->j0 - (first->i0 - obeg);
+          oend = last->i1 + context < ol->count
+            ? last->i1 + context
+            : ol->count;
+          nend = last->j1 + (oend - last->i1);
+
+          aputs ("@@ -", to);
+          show_unified_range (to, obeg, oend);
+          aputs (" +", to);
+          show_unified_range (to, nbeg, nend);
+          aputs (" @@\n", to);
+          for (i = obeg; first <= last; i = first++->i1)
+            {
+              show_lines (to, " ", ol, i, first->i0);
+              show_lines (to, "-", ol, first->i0, first->i1);
+              show_lines (to, "+", nl, first->j0, first->j1);
+            }
+          show_lines (to, " ", ol, i, oend);
+        }
+    }
+  close_space (space);
+  return n;
+}
+
+/* b-diff.c ends here */
@@ -0,0 +1,44 @@
+/* b-diff.h --- built-in line diff, producing RCS edit scripts
+
+   Copyright (C) 2010-2012 Thien-Thi Nguyen
+
+   This file is part of GNU RCS.
+
+   GNU RCS is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU RCS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty
+   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+   See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+struct difflines
+{
+  size_t count;
+  /* Number of lines.  */
+
+  char const **beg;
+  /* Start of each line; ‘beg[count]’ is the end of the text.  */
+
+  bool *changed;
+  /* Whether each line is outside the common subsequence.
+     Both ‘changed[-1]’ and ‘changed[count]’ are false.  */
+};
+
+extern void diff_split (struct divvy *space, struct cbuf text,
+                        struct difflines *dl);
+extern void diff_lines (struct divvy *space,
+                        struct cbuf old, struct cbuf new,
+                        struct difflines *ol, struct difflines *nl);
+extern void diff_stuffed (FILE *to, struct cbuf old, struct cbuf new);
+extern bool diff_show (FILE *to, struct difflines const *ol,
+                       struct difflines const *nl,
+                       long context, char const *label[2]);
+
+/* b-diff.h ends here */
@@ -26,8 +26,8 @@
 #include "b-complain.h"
 #include "b-divvy.h"
 
-struct divvy *plexus;
-struct divvy *single;
+THREAD_LOCAL struct divvy *plexus;
+THREAD_LOCAL struct divvy *single;
 
 static void
 oom (void)
@@ -74,7 +74,9 @@ make_space (char const name[])
 
   divvy->name = name;
   divvy->space = TCALLOC (struct obstack);
-  obstack_alloc_failed_handler = oom;
+  /* This is process-wide; avoid needless writes from each thread.  */
+  if (oom != obstack_alloc_failed_handler)
+    obstack_alloc_failed_handler = oom;
   obstack_init (divvy->space);
 
   /* Set alignment to avoid segfault (on some hosts).
@@ -26,8 +26,8 @@ struct divvy
   size_t count;
 };
 
-extern struct divvy *plexus;
-extern struct divvy *single;
+extern THREAD_LOCAL struct divvy *plexus;
+extern THREAD_LOCAL struct divvy *single;
 
 extern void *okalloc (void *p);
 extern struct divvy *make_space (char const name[]);
@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 #include "unistd-safer.h"
 #include "b-complain.h"
 #include "b-divvy.h"
@@ -122,13 +125,49 @@ jam_sff (struct sff *sff, const char *prefix)
 
 #define JAM_SFF(sff,prefix)  jam_sff (&sff, prefix)
 
+static bool
+anon_sff (struct sff *sff)
+/* Try to set ‘sff->filename’ to a name for a new anonymous file,
+   one that lives in memory and never appears in any directory.
+   The name (under /proc/self/fd) can be opened, truncated and
+   passed to child processes like that of a regular temporary file,
+   for as long as the descriptor remains open.  If successful, set
+   ‘sff->disposition’ to ‘anonymous’ and return true.  */
+{
+#ifdef HAVE_MEMFD_CREATE
+  char *fn;
+  size_t len;
+  int fd;
+
+  if (PROB (fd = fd_safer (memfd_create (PROGRAM (name), 0))))
+    return false;
+  accf (PLEXUS, "/proc/self/fd/%d", fd);
+  fn = finish_string (PLEXUS, &len);
+  /* Without /proc, the name is useless.  */
+  if (PROB (access (fn, W_OK)))
+    {
+      close (fd);
+      brush_off (PLEXUS, fn);
+      return false;
+    }
+  sff->filename = fn;
+  sff->disposition = anonymous;
+  sff->fd = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
 char const *
 maketemp (int n)
 /* Create a unique filename and store it into the ‘n’th slot
    in ‘EPH (tpnames)’ (so that ‘tempunlink’ can unlink the file later).
+   If possible, the file is anonymous (see ‘anon_sff’).
    Return a pointer to the filename created.  */
 {
-  if (!EPH (tpnames)[n].filename)
+  if (!EPH (tpnames)[n].filename
+      && !anon_sff (&EPH (tpnames)[n]))
     JAM_SFF (EPH (tpnames)[n], NULL);
 
   return EPH (tpnames)[n].filename;
@@ -181,7 +220,10 @@ reap (size_t count, struct sff all[count],
       {
         if (effective == m)
           seteid ();
-        cut (all[i].filename);
+        if (anonymous == m)
+          close (all[i].fd);
+        else
+          cut (all[i].filename);
         all[i].filename = NULL;
         if (effective == m)
           setrid ();
@@ -38,6 +38,7 @@
 #include "b-fb.h"
 #include "b-fro.h"
 #include "b-isr.h"
+#include "b-scan.h"
 
 #if MMAP_SIGNAL
 static void
@@ -48,14 +49,22 @@ mmap_deallocate (struct fro *f)
 }
 #endif  /* MMAP_SIGNAL */
 
+static struct fro *
+opened (struct fro *f)
+/* Record ‘f’ in ‘FLOW (opened)’, and return it.  */
+{
+  if (top)
+    {
+      f->next = FLOW (opened);
+      FLOW (opened) = f;
+    }
+  return f;
+}
+
 struct fro *
 fro_open (char const *name, char const *type, struct stat *status)
 /* Open ‘name’ for reading, return its descriptor, and set ‘*status’.  */
 {
-  struct fro *f;
-  FILE *stream;
-  struct stat st;
-  off_t s;
   int fd = fd_safer (open (name, O_RDONLY
 #if OPEN_O_BINARY
                            | (strchr (type, 'b') ? OPEN_O_BINARY : 0)
@@ -64,6 +73,19 @@ fro_open (char const *name, char const *type, struct stat *status)
 
   if (PROB (fd))
     return NULL;
+  return fro_fdopen (fd, name, type, status);
+}
+
+struct fro *
+fro_fdopen (int fd, char const *name, char const *type, struct stat *status)
+/* Like ‘fro_open’, for ‘fd’, an open descriptor for ‘name’.
+   The returned ‘struct fro’ takes over ‘fd’.  */
+{
+  struct fro *f;
+  FILE *stream;
+  struct stat st;
+  off_t s;
+
   if (!status)
     status = &st;
   if (PROB (fstat (fd, status)))
@@ -161,6 +183,40 @@ fro_open (char const *name, char const *type, struct stat *status)
     }
 
   f->fd = fd;
+  return opened (f);
+}
+
+static void
+free_deallocate (struct fro *f)
+{
+  free (f->base);
+}
+
+struct fro *
+fro_membuf (char *base, size_t size)
+/* Return a ‘struct fro’ for reading the ‘size’ bytes at ‘base’,
+   which were allocated with ‘malloc’ (e.g., by ‘open_memstream’).
+   It has no file descriptor; ‘fro_close’ frees ‘base’.  */
+{
+  struct fro *f = FZLLOC (struct fro);
+
+  f->fd = -1;
+  f->end = size;
+  f->rm = RM_MEM;
+  f->base = f->ptr = base;
+  f->lim = base + size;
+  f->deallocate = free_deallocate;
+  return opened (f);
+}
+
+struct fro *
+fro_memview (char const *base, size_t size)
+/* Like ‘fro_membuf’, but ‘fro_close’ leaves ‘base’ alone;
+   it must remain valid until then.  */
+{
+  struct fro *f = fro_membuf ((char *) base, size);
+
+  f->deallocate = NULL;
   return f;
 }
 
@@ -171,6 +227,13 @@ fro_close (struct fro *f)
 
   if (!f)
     return;
+  if (top)
+    for (struct fro **p = &FLOW (opened); *p; p = &(*p)->next)
+      if (f == *p)
+        {
+          *p = f->next;
+          break;
+        }
   switch (f->rm)
     {
     case RM_MMAP:
@@ -178,7 +241,9 @@ fro_close (struct fro *f)
       if (f->deallocate)
         (*f->deallocate) (f);
       f->base = NULL;
-      res = close (f->fd);
+      res = PROB (f->fd)
+        ? 0
+        : close (f->fd);
       break;
     case RM_STDIO:
       res = fclose (f->stream);
@@ -190,6 +255,33 @@ fro_close (struct fro *f)
   f->fd = -1;
 }
 
+void
+fro_abandon_all (void)
+/* Close every ‘struct fro’ in ‘FLOW (opened)’, ignoring errors.
+   This is for cleaning up after a fatal error.  */
+{
+  struct fro *f;
+
+  while ((f = FLOW (opened)))
+    {
+      /* Unlink first, so that a fatal error here cannot loop.  */
+      FLOW (opened) = f->next;
+      switch (f->rm)
+        {
+        case RM_MMAP:
+        case RM_MEM:
+          if (f->deallocate)
+            (*f->deallocate) (f);
+          if (!PROB (f->fd))
+            close (f->fd);
+          break;
+        case RM_STDIO:
+          fclose (f->stream);
+          break;
+        }
+    }
+}
+
 void
 fro_zclose (struct fro **p)
 {
@@ -305,9 +397,62 @@ fro_trundling (bool sequentialp USED_IF_HAVE_MADVISE, struct fro *f)
     }
 }
 
+#ifdef HAVE_COPY_FILE_RANGE
+/* Below this many bytes, the buffered copy is cheap enough.  */
+#define KERNEL_COPY_MIN  (64 * 1024)
+
+static off_t
+kernel_copy (FILE *to, struct fro *f, struct range const *r)
+/* Try to copy range ‘r’ of ‘f’ to ‘to’ with copy_file_range(2), so
+   that the bytes do not pass through user space (and a file system
+   that supports it can share the blocks instead).  This works only
+   if ‘to’ is a regular file.  Return the position in ‘f’ up to which
+   the copy was done, which is ‘r->beg’ if it was not done at all.  */
+{
+  int fd = fileno (to);
+  struct stat st;
+  off_t in = r->beg, out;
+  ssize_t count;
+
+  if (r->end - r->beg < KERNEL_COPY_MIN
+      || PROB (f->fd)
+      || PROB (fd)
+      || PROB (fstat (fd, &st))
+      || !S_ISREG (st.st_mode))
+    return in;
+  aflush (to);
+  if (PROB (out = lseek (fd, 0, SEEK_CUR)))
+    return in;
+  while (in < r->end)
+    {
+      if (PROB (count = copy_file_range (f->fd, &in, fd, &out,
+                                         r->end - in, 0)))
+        {
+          /* Let the caller copy the rest (possibly, all of it)
+             and diagnose any real error.  */
+          break;
+        }
+      if (!count)
+        /* The file must have shrunk!  */
+        break;
+    }
+  /* The output offset was passed explicitly; bring the
+     descriptor and the stream to the end of the copied bytes.  */
+  if (PROB (fseeko (to, out, SEEK_SET)))
+    Oerror ();
+  return in;
+}
+#endif  /* defined HAVE_COPY_FILE_RANGE */
+
 void
 fro_spew_partial (FILE *to, struct fro *f, struct range *r)
 {
+  struct range rest = *r;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  rest.beg = kernel_copy (to, f, r);
+#endif
+  r = &rest;
   switch (f->rm)
     {
     case RM_MMAP:
@@ -359,6 +504,132 @@ fro_spew (struct fro *f, FILE *to)
   f->verbatim = f->end;
 }
 
+static char const *
+atat_body (struct divvy *space, struct atat const *atat, size_t *len)
+/* Return the raw bytes between the opening and closing ‘SDELIM’ of
+   ‘atat’, that is, including any doubled ‘SDELIM’, setting ‘*len’
+   to their number.  If necessary, copy them to ‘space’.  */
+{
+  struct fro *f = atat->from;
+  struct range r =
+    {
+      .beg = 1 + atat->beg,
+      .end = ATAT_END (atat)
+    };
+
+  *len = r.end - r.beg;
+  switch (f->rm)
+    {
+    case RM_MMAP:
+    case RM_MEM:
+      return f->base + r.beg;
+    case RM_STDIO:
+      {
+        FILE *stream = f->stream;
+        off_t was = ftello (stream);
+        char *rv = alloc (space, "atat body", *len);
+
+        fseeko (stream, r.beg, SEEK_SET);
+        if (*len != fread (rv, 1, *len, stream))
+          testIerror (stream);
+        fseeko (stream, was, SEEK_SET);
+        return rv;
+      }
+    }
+  return NULL;
+}
+
+static void
+lazy_pieces (struct atat const *atat,
+             void (*piece) (void *, char const *, size_t),
+             void *closure)
+/* Call ‘piece’ on each run of bytes of lazy atat ‘atat’,
+   with doubled ‘SDELIM’ replaced by single ‘SDELIM’.  */
+{
+  struct divvy *scratch = make_space ("lazy");
+  size_t len;
+  char const *p = atat_body (scratch, atat, &len);
+  char const *lim = p + len;
+  char const *at;
+
+  while ((at = scan_sdelim (p, lim, NULL)) < lim)
+    {
+      /* Include the first ‘SDELIM’ of the pair, skip the second.  */
+      (*piece) (closure, p, at + 1 - p);
+      p = at + 2;
+    }
+  if (p < lim)
+    (*piece) (closure, p, lim - p);
+  close_space (scratch);
+}
+
+static void
+accumulate_piece (void *closure, char const *beg, size_t len)
+{
+  accumulate_range (closure, beg, beg + len);
+}
+
+static void
+write_piece (void *closure, char const *beg, size_t len)
+{
+  awrite (beg, len, closure);
+}
+
+void
+fro_spew_stuffed (struct fro *f, FILE *to)
+/* Copy the remainder of file ‘f’ to ‘to’, doubling each ‘SDELIM’.  */
+{
+  switch (f->rm)
+    {
+    case RM_MMAP:
+    case RM_MEM:
+      stuff_sdelim (to, f->ptr, f->lim - f->ptr);
+      f->ptr = f->lim;
+      break;
+    case RM_STDIO:
+      {
+        char buf[8 * BUFSIZ];
+        size_t count;
+
+        while ((count = fread (buf, 1, sizeof (buf), f->stream)))
+          stuff_sdelim (to, buf, count);
+        testIerror (f->stream);
+      }
+      break;
+    }
+}
+
+struct cbuf
+fro_contents (struct divvy *space, struct fro *f)
+/* Return the entire contents of ‘f’, copying them to ‘space’
+   if necessary.  The position of ‘f’ is unchanged.  */
+{
+  struct cbuf rv;
+
+  rv.size = f->end;
+  switch (f->rm)
+    {
+    case RM_MMAP:
+    case RM_MEM:
+      rv.string = f->base;
+      break;
+    case RM_STDIO:
+      {
+        FILE *stream = f->stream;
+        off_t was = ftello (stream);
+        char *buf = alloc (space, "contents", rv.size);
+
+        fseeko (stream, 0, SEEK_SET);
+        if (rv.size != fread (buf, 1, rv.size, stream))
+          testIerror (stream);
+        fseeko (stream, was, SEEK_SET);
+        rv.string = buf;
+      }
+      break;
+    }
+  return rv;
+}
+
 struct cbuf
 string_from_atat (struct divvy *space, struct atat const *atat)
 {
@@ -368,6 +639,12 @@ string_from_atat (struct divvy *space, struct atat const *atat)
   struct cbuf cb;
   size_t i;
 
+  if (atat->lazy)
+    {
+      lazy_pieces (atat, accumulate_piece, space);
+      cb.string = finish_string (space, &cb.size);
+      return cb;
+    }
   for (i = 0; i < count; i++)
     {
       r[i].beg = 1 + (i ? atat->holes[i - 1] : atat->beg);
@@ -395,14 +672,26 @@ string_from_atat (struct divvy *space, struct atat const *atat)
       {
         FILE *stream = f->stream;
         off_t was = ftello (stream);
+        char buf[BUFSIZ];
 
         for (i = 0; i < count; i++)
           {
             off_t pos = r[i].beg;
+            size_t n;
 
             fseeko (stream, pos, SEEK_SET);
-            while (pos++ < r[i].end)
-              accumulate_byte (space, getc (f->stream));
+            for (; pos < r[i].end; pos += n)
+              {
+                if (! (n = fread (buf, 1, (r[i].end - pos < BUFSIZ
+                                           ? r[i].end - pos
+                                           : BUFSIZ),
+                                  stream)))
+                  {
+                    testIerror (stream);
+                    break;
+                  }
+                accumulate_range (space, buf, buf + n);
+              }
           }
         fseeko (stream, was, SEEK_SET);
       }
@@ -412,6 +701,33 @@ string_from_atat (struct divvy *space, struct atat const *atat)
   return cb;
 }
 
+bool
+fro_has_kdelim (struct fro *f, struct range const *r)
+/* Return true if range ‘r’ of ‘f’ might contain ‘KDELIM’, i.e.,
+   keyword expansion might change it.  The answer is exact if ‘f’
+   is in memory; otherwise, it is always true.  */
+{
+  return STDIO_P (f)
+    || memchr (f->base + r->beg, KDELIM, r->end - r->beg);
+}
+
+bool
+atat_has_kdelim (struct atat const *atat)
+/* Like ‘fro_has_kdelim’, for the text of ‘atat’.  */
+{
+  struct range r =
+    {
+      .beg = 1 + atat->beg,
+      .end = ATAT_END (atat)
+    };
+
+#if WITH_NEEDEXP
+  if (!atat->lazy)
+    return 0 < atat->needexp_count;
+#endif
+  return fro_has_kdelim (atat->from, &r);
+}
+
 void
 atat_put (FILE *to, struct atat const *atat)
 {
@@ -427,16 +743,19 @@ atat_put (FILE *to, struct atat const *atat)
 void
 atat_display (FILE *to, struct atat const *atat, bool ensure_newline_p)
 {
-  for (size_t i = 0; i < atat->count; i++)
-    {
-      struct range range =
-        {
-          .beg = 1 + (i ? atat->holes[i - 1] : atat->beg),
-          .end = atat->holes[i]
-        };
+  if (atat->lazy)
+    lazy_pieces (atat, write_piece, to);
+  else
+    for (size_t i = 0; i < atat->count; i++)
+      {
+        struct range range =
+          {
+            .beg = 1 + (i ? atat->holes[i - 1] : atat->beg),
+            .end = atat->holes[i]
+          };
 
-      fro_spew_partial (to, atat->from, &range);
-    }
+        fro_spew_partial (to, atat->from, &range);
+      }
 
   /* Don't bother with trailing '\n' output if not requested,
      or if the atat is empty.  */
@@ -473,4 +792,77 @@ atat_display (FILE *to, struct atat const *atat, bool ensure_newline_p)
   }
 }
 
+static size_t
+count_newlines (char const *p, size_t len)
+{
+  char const *lim = p + len;
+  size_t count = 0;
+
+  while ((p = memchr (p, '\n', lim - p)))
+    p++, count++;
+  return count;
+}
+
+size_t
+fro_line_number (struct fro *f, off_t pos)
+/* Return the line number (1-origin) of position ‘pos’ in ‘f’.  */
+{
+  size_t count = 0;
+
+  switch (f->rm)
+    {
+    case RM_MMAP:
+    case RM_MEM:
+      count = count_newlines (f->base, pos);
+      break;
+    case RM_STDIO:
+      {
+        FILE *stream = f->stream;
+        off_t was = ftello (stream);
+        int c;
+
+        fseeko (stream, 0, SEEK_SET);
+        while (pos-- && EOF != (c = getc (stream)))
+          count += ('\n' == c);
+        testIerror (stream);
+        fseeko (stream, was, SEEK_SET);
+      }
+      break;
+    }
+  return 1 + count;
+}
+
+size_t
+atat_lno (struct atat const *atat)
+/* Return the line number of the opening ‘SDELIM’ of ‘atat’.  */
+{
+  if (! atat->lno)
+    /* Cache it; the only way to get a zero here is if ‘atat’ is lazy.  */
+    ((struct atat *) atat)->lno = fro_line_number (atat->from, atat->beg);
+  return atat->lno;
+}
+
+size_t
+atat_line_count (struct atat const *atat)
+/* Return the number of lines in ‘atat’, counting a final
+   partial line (or an empty atat) as one line.  */
+{
+  if (! atat->line_count)
+    {
+      struct divvy *scratch = make_space ("lazy");
+      size_t len;
+      char const *p = atat_body (scratch, atat, &len);
+      char const *q = p + len;
+
+      /* Like ‘maybe_read_atat’, disregard ‘SDELIM’ in
+         determining whether the last line is partial.  */
+      while (p < q && SDELIM == q[-1])
+        q--;
+      ((struct atat *) atat)->line_count = count_newlines (p, len)
+        + (p == q || '\n' != q[-1]);
+      close_space (scratch);
+    }
+  return atat->line_count;
+}
+
 /* b-fro.c ends here */
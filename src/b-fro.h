@@ -42,6 +42,8 @@ struct fro
   void (*deallocate) (struct fro *f);
   FILE *stream;
   off_t verbatim;
+  struct fro *next;
+  /* The next in ‘FLOW (opened)’.  */
 };
 
 struct atat
@@ -49,7 +51,13 @@ struct atat
   size_t count;
   size_t lno;
   size_t line_count;
+  /* For a lazy atat, these are 0 until computed on demand
+     (see ‘atat_lno’ and ‘atat_line_count’).  */
   struct fro *from;
+  bool lazy;
+  /* If set, the holes (see below) have not been computed;
+     ‘count’ is 1 and ‘holes[0]’ is the position of the closing
+     ‘SDELIM’, with any doubled ‘SDELIM’ still in the range.  */
 #if WITH_NEEDEXP
   size_t needexp_count;
   bool (*ineedexp) (struct atat *atat, size_t i);
@@ -68,8 +76,13 @@ struct atat
 
 extern struct fro *fro_open (char const *filename, char const *type,
                              struct stat *status);
+extern struct fro *fro_fdopen (int fd, char const *name, char const *type,
+                               struct stat *status);
+extern struct fro *fro_membuf (char *base, size_t size);
+extern struct fro *fro_memview (char const *base, size_t size);
 extern void fro_zclose (struct fro **p);
 extern void fro_close (struct fro *f);
+extern void fro_abandon_all (void);
 extern off_t fro_tello (struct fro *f);
 extern void fro_move (struct fro *f, off_t change);
 extern bool fro_try_getbyte (int *c, struct fro *f);
@@ -77,10 +90,17 @@ extern void fro_must_getbyte (int *c, struct fro *f);
 extern void fro_trundling (bool sequentialp, struct fro *f);
 extern void fro_spew_partial (FILE *to, struct fro *f, struct range *r);
 extern void fro_spew (struct fro *f, FILE *to);
+extern void fro_spew_stuffed (struct fro *f, FILE *to);
+extern struct cbuf fro_contents (struct divvy *space, struct fro *f);
 extern struct cbuf string_from_atat (struct divvy *space, struct atat const *atat);
+extern bool fro_has_kdelim (struct fro *f, struct range const *r);
+extern bool atat_has_kdelim (struct atat const *atat);
 extern void atat_put (FILE *to, struct atat const *atat);
 extern void atat_display (FILE *to, struct atat const *atat,
                           bool ensure_newline_p);
+extern size_t fro_line_number (struct fro *f, off_t pos);
+extern size_t atat_lno (struct atat const *atat);
+extern size_t atat_line_count (struct atat const *atat);
 
 /* Idioms.  */
 
@@ -20,16 +20,26 @@
 
 #include "base.h"
 #include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 #include <obstack.h>
 #include "hash-pjw.h"
+#include "stat-time.h"
 #include "b-complain.h"
 #include "b-divvy.h"
 #include "b-esds.h"
+#include "b-fb.h"
 #include "b-fro.h"
 #include "b-grok.h"
+#include "b-scan.h"
 
 /* Define to 1 to enable the context stack.  */
 #define CONTEXTUAL 0
@@ -62,6 +72,10 @@ struct grok
   struct cbuf xrep;
   size_t lno;
   size_t head_lno;
+  bool lazy;
+  /* Set means ‘maybe_read_atat’ may skim (see ‘skim_atat’).  */
+  bool lno_stale;
+  /* Set means ‘lno’ does not count lines in skimmed atats.  */
   struct cbuf bor_no;                   /* branch or revision */
 };
 
@@ -118,6 +132,9 @@ ignoble (struct grok *g, char const *fmt, ...)
     }
 #endif  /* CONTEXTUAL */
   msg.string = finish_string (scratch, &msg.size);
+  if (g->lno_stale)
+    g->lno = fro_line_number (g->from, fro_tello (g->from) - 1)
+      + ('\n' == g->c);
   complain ("\n");
   fatal_syntax (g->lno, "%s", msg.string);
 }
@@ -333,6 +350,127 @@ atat_ineedexp_few (struct atat *atat, size_t i)
 
 #define MANYP(atat,x)  ((8 * sizeof (atat->needexp.direct)) <= (x))
 
+static bool
+skim_atat (struct grok *g, struct atat **res)
+/* Like ‘maybe_read_atat’, but only find the closing ‘SDELIM’, leaving
+   ‘holes’, ‘lno’ and ‘line_count’ to be computed on demand.  Assume
+   ‘g->from’ is in memory, and that ‘g->c’ is the opening ‘SDELIM’.  */
+{
+  struct fro *f = g->from;
+  char *p = f->ptr;
+  char *at;
+  struct atat *atat;
+
+  for (;;)
+    {
+      at = (char *) scan_sdelim (p, f->lim, NULL);
+      if (f->lim - at <= 1)
+        {
+          /* Position things as ‘maybe_read_atat’ would.  */
+          f->ptr = f->lim;
+          g->c = f->lim[-1];
+          g->lno_stale = true;
+          eof_too_soon (g);
+        }
+      if (SDELIM != at[1])
+        break;
+      p = at + 2;
+    }
+  atat = alloc (g->to, "atat", sizeof (struct atat) + sizeof (off_t));
+  atat->count = 1;
+  atat->lno = atat->line_count = 0;
+  atat->from = f;
+  atat->lazy = true;
+  atat->beg = f->ptr - 1 - f->base;
+  atat->holes[0] = at - f->base;
+  f->ptr = at + 1;
+  MORE (g);
+  g->lno_stale = true;
+  *res = atat;
+  return true;
+}
+
+static void
+scan_atat (struct grok *g, bool *newlinep)
+/* Scan the atat whose opening ‘SDELIM’ is ‘g->c’, a window at a time,
+   recording its holes (in ‘g->systolic’) and updating ‘g->lno’ and
+   ‘*newlinep’.  Leave ‘g->c’ as the byte after the closing ‘SDELIM’.  */
+{
+  struct fro *f = g->from;
+  struct obstack *o = g->systolic->space;
+#define SCANBUFSIZ  (8 * BUFSIZ)
+  char buf[STDIO_P (f) ? SCANBUFSIZ : 1];
+  off_t pos = fro_tello (f);
+  bool needexp = false;
+
+  for (;;)
+    {
+      char const *wbeg, *p, *end;
+      off_t hole;
+
+      /* Get a window starting at ‘pos’.  */
+      if (STDIO_P (f))
+        {
+          FILE *stream = f->stream;
+
+          fseeko (stream, pos, SEEK_SET);
+          end = buf + fread (buf, 1, SCANBUFSIZ, stream);
+          testIerror (stream);
+          wbeg = buf;
+        }
+      else
+        {
+          wbeg = f->base + pos;
+          end = f->lim;
+        }
+
+      for (p = wbeg; p < end;)
+        {
+          size_t nl = 0;
+          char const *at = scan_sdelim (p, end, &nl);
+
+#define WPOS(x)  (pos + ((x) - wbeg))
+
+          g->lno += nl;
+          if (p < at)
+            *newlinep = ('\n' == at[-1]);
+          if (WITH_NEEDEXP && !needexp)
+            needexp = !! memchr (p, KDELIM, at - p);
+          if (end - at <= 1)
+            {
+              /* Need to see the byte after ‘SDELIM’, if any.  */
+              p = at;
+              break;
+            }
+          if (SDELIM == at[1])
+            {
+              hole = (needexp ? MASK_OFFMSB : 0) | WPOS (at + 1);
+              obstack_grow (o, &hole, sizeof (hole));
+              needexp = false;
+              p = at + 2;
+              continue;
+            }
+          hole = (needexp ? MASK_OFFMSB : 0) | WPOS (at);
+          obstack_grow (o, &hole, sizeof (hole));
+          g->c = at[1];
+          fro_move (f, WPOS (at + 2));
+          return;
+        }
+
+      if (pos == WPOS (p))
+        {
+          /* No progress; position things as the bytewise scan would.  */
+          fro_move (f, f->end);
+          if (wbeg < end)
+            g->c = end[-1];
+          eof_too_soon (g);
+        }
+      pos = WPOS (p);
+#undef WPOS
+    }
+#undef SCANBUFSIZ
+}
+
 static bool
 maybe_read_atat (struct grok *g, struct atat **res)
 {
@@ -345,27 +483,16 @@ maybe_read_atat (struct grok *g, struct atat **res)
 
   CBEG ("atat");
   skip_whitespace (g);
+  if (g->lazy && SDELIM == g->c)
+    {
+      CEND ();
+      return skim_atat (g, res);
+    }
   lno_start = g->lno;
   beg = POS (-1);
   start_atat (g->systolic, true);
-  while (SDELIM == g->c)
-    {
-      off_t hole;
-      bool needexp = false;
-
-      MORE (g);
-      while (SDELIM != g->c)
-        {
-          if (WITH_NEEDEXP && KDELIM == g->c)
-            needexp = true;
-          else if ((newlinep = ('\n' == g->c)))
-            g->lno++;
-          MORE (g);
-        }
-      MORE (g);
-      hole = (needexp ? MASK_OFFMSB : 0) | POS (SDELIM == g->c ? -1 : -2);
-      obstack_grow (g->systolic->space, &hole, sizeof (hole));
-    }
+  if (SDELIM == g->c)
+    scan_atat (g, &newlinep);
   if ((atat = finish_atat (g->systolic)))
     {
       size_t count = atat->count;
@@ -396,6 +523,7 @@ maybe_read_atat (struct grok *g, struct atat **res)
 
       atat->lno = lno_start;
       atat->line_count = g->lno - atat->lno + !newlinep;
+      atat->lazy = false;
       atat->beg = beg;
       atat->from = g->from;
 
@@ -509,6 +637,155 @@ gethash (char const *revno, struct hash *ht)
   return NULL;
 }
 
+
+struct revindex
+{
+  size_t mask;
+  struct delta **slot;
+};
+
+/* Stand-in for a delta removed after indexing, so that
+   probing continues past its slot.  */
+static struct delta gone;
+
+static struct revindex *
+index_deltas (struct divvy *to, struct repo *repo)
+/* Return a new open-addressing table of ‘repo->deltas’, keyed
+   by revision number.  The table is at most half full.  */
+{
+  struct revindex *ix = alloc (to, "revindex", sizeof (struct revindex));
+  size_t sz = 16;
+
+  while (sz < 2 * repo->deltas_count)
+    sz <<= 1;
+  ix->mask = sz - 1;
+  ix->slot = zlloc (to, "revindex slots", sz * sizeof (struct delta *));
+  for (struct wlink *ls = repo->deltas; ls; ls = ls->next)
+    {
+      struct delta *d = ls->entry;
+      size_t i = hash_pjw (d->num, sz);
+
+      while (ix->slot[i])
+        i = (i + 1) & ix->mask;
+      ix->slot[i] = d;
+    }
+  return ix;
+}
+
+static struct delta **
+index_slot (struct revindex *ix, char const *revno)
+{
+  struct delta *d;
+
+  for (size_t i = hash_pjw (revno, 1 + ix->mask);
+       (d = ix->slot[i]);
+       i = (i + 1) & ix->mask)
+    if (&gone != d && STR_SAME (revno, d->num))
+      return ix->slot + i;
+  return NULL;
+}
+
+
+struct symindex
+{
+  size_t count;                         /* including ‘gone_sym’ */
+  size_t mask;
+  bool dups;                            /* some name defined twice */
+  struct link **slot;                   /* in ‘repo->symbols’ */
+};
+
+/* Like ‘gone’, for a dropped symbolic name.  */
+static struct link gone_sym;
+
+#define SYMDEF(ls)  ((struct symdef const *) (ls)->entry)
+
+static struct link **
+symindex_slot (struct symindex *ix, char const *name, size_t len)
+/* Return the slot in ‘ix’ for the definition of ‘name’ (‘len’ bytes,
+   not necessarily NUL-terminated), or NULL if there is none.  */
+{
+  char *copy = NULL;
+  struct link *ls;
+  size_t i;
+
+  /* ‘hash_pjw’ wants a NUL-terminated string.  */
+  if (name[len])
+    {
+      accumulate_range (SINGLE, name, name + len);
+      name = copy = finish_string (SINGLE, &len);
+    }
+  for (i = hash_pjw (name, 1 + ix->mask);
+       (ls = ix->slot[i]);
+       i = (i + 1) & ix->mask)
+    if (&gone_sym != ls
+        && !strncmp (SYMDEF (ls)->meaningful, name, len)
+        && !SYMDEF (ls)->meaningful[len])
+      break;
+  if (copy)
+    brush_off (SINGLE, copy);
+  return ls ? ix->slot + i : NULL;
+}
+
+#define SYMSLOT(ix,name)  symindex_slot (ix, name, strlen (name))
+
+static void
+symindex_put (struct symindex *ix, struct link *ls)
+/* Add ‘ls’ to ‘ix’, which must have room for it.  */
+{
+  char const *name = SYMDEF (ls)->meaningful;
+  size_t i = hash_pjw (name, 1 + ix->mask);
+
+  while (ix->slot[i])
+    i = (i + 1) & ix->mask;
+  ix->slot[i] = ls;
+  ix->count++;
+}
+
+static void
+symindex_resize (struct symindex *ix, size_t want)
+/* Make room in ‘ix’ for ‘want’ definitions, keeping the live ones
+   and discarding any ‘gone_sym’.  */
+{
+  struct link **old = ix->slot;
+  size_t oldsz = old ? 1 + ix->mask : 0;
+  size_t sz = 16;
+
+  while (sz < 2 * want)
+    sz <<= 1;
+  ix->count = 0;
+  ix->mask = sz - 1;
+  ix->slot = zlloc (SINGLE, "symindex slots", sz * sizeof (struct link *));
+  for (size_t i = 0; i < oldsz; i++)
+    if (old[i] && &gone_sym != old[i])
+      symindex_put (ix, old[i]);
+}
+
+static struct symindex *
+symindex (struct repo *repo)
+/* Return the symbol index of ‘repo’, building it from ‘repo->symbols’
+   if necessary.  As with a linear search, the first definition of
+   a name in the list wins.  */
+{
+  struct symindex *ix = repo->symindex;
+
+  if (!ix)
+    {
+      size_t count = 0;
+
+      for (struct link *ls = repo->symbols; ls; ls = ls->next)
+        count++;
+      ix = repo->symindex = zlloc (SINGLE, "symindex",
+                                   sizeof (struct symindex));
+      symindex_resize (ix, count);
+      for (struct link *ls = repo->symbols; ls; ls = ls->next)
+        if (SYMSLOT (ix, SYMDEF (ls)->meaningful))
+          ix->dups = true;
+        else
+          symindex_put (ix, ls);
+    }
+  return ix;
+}
+
 
 struct fwref
 {
@@ -534,6 +811,30 @@ static const char ks_ner[] = "non-existent revision";
 
 #define FIND_NY(revno)  gethash (revno, repo->ht)
 
+static void
+dangling_lockdefs (struct divvy *to, struct repo *repo)
+/* Handle dangling lockdefs, that is, those whose revno references a
+   non-existent delta.  */
+{
+  for (struct lockdef const *lock = repo->lockdefs;
+       lock < repo->lockdefs + repo->locks_count;
+       lock++)
+    {
+      struct notyet *ny = FIND_NY (lock->revno);
+
+      if (! ny)
+        /* Create a dummy, hashed but not added to ‘repo->deltas’.  */
+        {
+          RWARN ("user `%s' holds a lock for %s `%s'",
+                 lock->login, ks_ner, lock->revno);
+          ny = zlloc (to, "dummy ny", sizeof (struct notyet));
+          ny->d = zlloc (to, "dummy delta", sizeof (struct delta));
+          ny->revno = ny->d->num = lock->revno;
+          puthash (to, ny, repo->ht);
+        }
+    }
+}
+
 static struct repo *
 full (struct divvy *to, struct fro *f)
 {
@@ -679,6 +980,7 @@ full (struct divvy *to, struct fro *f)
         size_t numlen = XREP (g).size;
 
         STASH (d->num);
+        d->tuple = make_revtuple (to, d->num);
         /* Check that a new branch is properly forward-referenced.  */
         if (prev && !prev->next
             && 2 <= countnumflds (d->num))
@@ -779,6 +1081,9 @@ full (struct divvy *to, struct fro *f)
 
   SYNCH (g, desc);
   repo->neck = fro_tello (g->from);
+  /* From here on, atats are numerous and potentially large; if
+     everything is in memory, don't scan them in full until needed.  */
+  g->lazy = !WITH_NEEDEXP && !STDIO_P (f);
   MUST_ATAT (g, &repo->desc, desc);
 
   CEND ();
@@ -787,26 +1092,9 @@ full (struct divvy *to, struct fro *f)
 #undef PREP
 #undef STASH
 
-  /* Handle dangling lockdefs, that is, those whose revno references a
-     non-existent delta.  Do it here instead of lazily (in ‘grok_resynch’)
+  /* Do it here instead of lazily (in ‘grok_resynch’)
      to avoid emitting multiple warnings.  */
-  for (struct lockdef const *lock = repo->lockdefs;
-       lock < repo->lockdefs + repo->locks_count;
-       lock++)
-    {
-      struct notyet *ny = FIND_NY (lock->revno);
-
-      if (! ny)
-        /* Create a dummy, hashed but not added to ‘repo->deltas’.  */
-        {
-          RWARN ("user `%s' holds a lock for %s `%s'",
-                 lock->login, ks_ner, lock->revno);
-          ny = zlloc (to, "dummy ny", sizeof (struct notyet));
-          ny->d = zlloc (to, "dummy delta", sizeof (struct delta));
-          ny->revno = ny->d->num = lock->revno;
-          puthash (to, ny, repo->ht);
-        }
-    }
+  dangling_lockdefs (to, repo);
 
   CBEG ("edits");
   for (count = 0, follow = repo->deltas;
@@ -897,15 +1185,848 @@ full (struct divvy *to, struct fro *f)
   return repo;
 }
 
+
+/* Sidecar cache.
+
+   If ‘BE (grok_cache)’ names a directory, ‘grok_all’ saves the result
+   of ‘full’ there in a private binary format, and consults it on the
+   next call for the same RCS file, instead of parsing again.  The cache
+   file is named for the device and inode of the RCS file, and carries
+   its size, mtime and ctime as well; any mismatch (or any other sign
+   of trouble) means a fresh parse.  So does a cache file that someone
+   else could have written (see ‘cache_open’).  Saving is best-effort:
+   failures are silently ignored.
+
+   All values are written as 8-byte words in host byte order.  A string
+   is its length (or ‘NIL_WORD’ for NULL), followed by its bytes, a NUL,
+   and padding to the next word boundary.  An atat is its count (or
+   ‘NIL_WORD’ for NULL), ‘lno’, ‘line_count’, ‘lazy’, ‘beg’ and the
+   holes.  */
+
+#define GCACHE_MAGIC    "RCSgrok"
+#define GCACHE_VERSION  2
+#define NIL_WORD        UINT64_MAX
+#define WORDSIZE        sizeof (uint64_t)
+#define PADDED(n)       (((n) + WORDSIZE - 1) / WORDSIZE * WORDSIZE)
+
+void
+cache_set_key (struct cache_key *key, char const *magic,
+               uint64_t version, struct stat const *st)
+/* Set ‘key’, the header of a cache file, from ‘magic’ (at most seven
+   bytes), ‘version’ and the status ‘st’ of the file it describes.  */
+{
+  struct timespec mtime, ctime;
+
+  memset (key, 0, sizeof (*key));
+  memcpy (&key->magic, magic, strlen (magic) + 1);
+  key->version = version;
+  key->dev = st->st_dev;
+  key->ino = st->st_ino;
+  key->size = st->st_size;
+  mtime = get_stat_mtime (st);
+  ctime = get_stat_ctime (st);
+  key->mtime = mtime.tv_sec;
+  key->mtime_ns = mtime.tv_nsec;
+  key->ctime = ctime.tv_sec;
+  key->ctime_ns = ctime.tv_nsec;
+}
+
+static bool
+private_p (struct stat const *st)
+/* Return true if ‘st’ describes something that belongs to
+   us and that no one else can write.  */
+{
+  return st->st_uid == geteuid ()
+    && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+int
+cache_open (char const *dir, char const *filename, struct stat *st)
+/* Open the cache file ‘filename’ in ‘dir’ for reading, set ‘*st’,
+   and return its descriptor.  Return -1 if there is no such file,
+   or if it is not a regular file, or if it or ‘dir’ might have been
+   written by someone else (so that its contents are not to be
+   trusted).  */
+{
+  struct stat dst;
+  int fd = open (filename, O_RDONLY | O_NOFOLLOW | OPEN_O_BINARY);
+
+  if (! PROB (fd)
+      && (PROB (fstat (fd, st))
+          || !S_ISREG (st->st_mode)
+          || !private_p (st)
+          || PROB (stat (dir, &dst))
+          || !private_p (&dst)))
+    {
+      close (fd);
+      fd = -1;
+    }
+  return fd;
+}
+
+off_t
+cache_write (char const *filename,
+             void (*writer) (FILE *f, void const *data),
+             void const *data)
+/* Call ‘writer’ to write ‘data’ to a temporary file, then rename
+   that to ‘filename’, so that a concurrent reader never sees a
+   partial cache file.  Return the size of the file, or -1 if
+   anything goes wrong (in which case ‘filename’ is not touched).  */
+{
+  struct divvy *space = make_space ("cache");
+  off_t size = -1;
+  char *tmp;
+  size_t len;
+  FILE *f;
+  int fd;
+
+  accf (space, "%s.XXXXXX", filename);
+  tmp = finish_string (space, &len);
+  if (! PROB (fd = mkstemp (tmp)))
+    {
+      if (!(f = fdopen (fd, FOPEN_WB)))
+        close (fd);
+      else
+        {
+          writer (f, data);
+          size = ferror (f) ? -1 : ftello (f);
+          if (fclose (f))
+            size = -1;
+        }
+      if (PROB (size) || PROB (rename (tmp, filename)))
+        {
+          size = -1;
+          unlink (tmp);
+        }
+    }
+  close_space (space);
+  return size;
+}
+
+static char const *
+gcache_filename (struct divvy *space, struct stat const *st)
+{
+  size_t len;
+
+  accf (space, "%s%c%lx-%lx.grok", BE (grok_cache), SLASH,
+        (unsigned long) st->st_dev, (unsigned long) st->st_ino);
+  return finish_string (space, &len);
+}
+
+/* In-memory tier.
+
+   A long-lived process that nests many invocations (e.g., "grcs serve")
+   can set ‘gmemo’ to keep the cache images in memory, as well.  Images
+   are looked up by device and inode, and validated by their key, just
+   like the cache files.  When the images total more than the limit
+   (or all the slots are full), the least recently used are dropped.
+   An entry can also hold the text of the head revision, which counts
+   toward the limit, too, and goes with the entry.  */
+
+#define GMEMO_SLOTS  256
+
+struct gmemo_entry
+{
+  char *buf;
+  size_t size;
+  unsigned long used;
+  char *head;
+  size_t head_size;
+};
+
+struct gmemo
+{
+  size_t limit;
+  size_t total;
+  unsigned long clock;
+  struct gmemo_entry slot[GMEMO_SLOTS];
+};
+
+THREAD_LOCAL struct gmemo *gmemo;
+
+struct gmemo *
+make_gmemo (size_t limit)
+/* Return a new (empty) in-memory cache that holds at most
+   ‘limit’ bytes.  It is not freed.  */
+{
+  struct gmemo *memo = okalloc (calloc (1, sizeof (struct gmemo)));
+
+  memo->limit = limit;
+  return memo;
+}
+
+static bool
+gmemo_same_file (struct gmemo_entry const *ent, struct cache_key const *want)
+{
+  struct cache_key key;
+
+  memcpy (&key, ent->buf, sizeof (key));
+  return key.dev == want->dev && key.ino == want->ino;
+}
+
+static void
+gmemo_drop (struct gmemo_entry *ent)
+{
+  gmemo->total -= ent->size + ent->head_size;
+  free (ent->buf);
+  ent->buf = NULL;
+  free (ent->head);
+  ent->head = NULL;
+  ent->head_size = 0;
+}
+
+static struct gmemo_entry *
+gmemo_find (struct stat const *st)
+/* Return the entry for ‘st’, or NULL if there is none.
+   Drop an entry for the same file that is out of date.  */
+{
+  struct cache_key want;
+
+  cache_set_key (&want, GCACHE_MAGIC, GCACHE_VERSION, st);
+  for (size_t i = 0; i < GMEMO_SLOTS; i++)
+    {
+      struct gmemo_entry *ent = gmemo->slot + i;
+
+      if (ent->buf && gmemo_same_file (ent, &want))
+        {
+          if (memcmp (ent->buf, &want, sizeof (want)))
+            {
+              gmemo_drop (ent);
+              return NULL;
+            }
+          ent->used = ++gmemo->clock;
+          return ent;
+        }
+    }
+  return NULL;
+}
+
+static char const *
+gmemo_get (struct stat const *st, size_t *size)
+/* Return the image for ‘st’ (setting ‘*size’), or NULL if there is
+   none.  */
+{
+  struct gmemo_entry *ent = gmemo_find (st);
+
+  if (! ent)
+    return NULL;
+  *size = ent->size;
+  return ent->buf;
+}
+
+bool
+gmemo_head (struct stat const *st, struct cbuf *text)
+/* If ‘gmemo’ holds the text of the head revision of the RCS file
+   whose status is ‘st’, set ‘*text’ to it and return true.
+   The text remains valid until the next call to a ‘gmemo’ func.  */
+{
+  struct gmemo_entry *ent;
+
+  if (! gmemo || ! (ent = gmemo_find (st)) || ! ent->head)
+    return false;
+  text->string = ent->head;
+  text->size = ent->head_size;
+  return true;
+}
+
+void
+gmemo_put_head (struct stat const *st, struct cbuf text)
+/* Save a copy of ‘text’ as the text of the head revision of the
+   RCS file whose status is ‘st’, if ‘gmemo’ has an entry for it
+   (that is, if it was parsed), and there is room.  */
+{
+  struct gmemo_entry *ent;
+
+  if (! gmemo || ! (ent = gmemo_find (st)) || ent->head
+      || gmemo->limit - gmemo->total < text.size)
+    return;
+  ent->head = okalloc (malloc (text.size ? text.size : 1));
+  memcpy (ent->head, text.string, text.size);
+  ent->head_size = text.size;
+  gmemo->total += text.size;
+}
+
+static void
+gmemo_put (char const *buf, size_t size)
+/* Save a copy of the image ‘buf’ (‘size’ bytes), replacing
+   any other for the same file, and evicting as necessary.  */
+{
+  struct cache_key want;
+  struct gmemo_entry *ent;
+
+  if (size > gmemo->limit)
+    return;
+  memcpy (&want, buf, sizeof (want));
+  for (size_t i = 0; i < GMEMO_SLOTS; i++)
+    if (gmemo->slot[i].buf && gmemo_same_file (gmemo->slot + i, &want))
+      gmemo_drop (gmemo->slot + i);
+  for (;;)
+    {
+      struct gmemo_entry *lru = NULL;
+
+      ent = NULL;
+      for (size_t i = 0; i < GMEMO_SLOTS; i++)
+        {
+          struct gmemo_entry *cur = gmemo->slot + i;
+
+          if (! cur->buf)
+            ent = cur;
+          else if (! lru || cur->used < lru->used)
+            lru = cur;
+        }
+      if (ent && gmemo->limit - gmemo->total >= size)
+        break;
+      gmemo_drop (lru);
+    }
+  ent->buf = okalloc (malloc (size));
+  memcpy (ent->buf, buf, size);
+  ent->size = size;
+  ent->used = ++gmemo->clock;
+  gmemo->total += size;
+}
+
+static void
+put_word (struct obstack *o, uint64_t w)
+{
+  obstack_grow (o, &w, WORDSIZE);
+}
+
+static void
+put_string (struct obstack *o, char const *s)
+{
+  size_t len;
+
+  if (!s)
+    {
+      put_word (o, NIL_WORD);
+      return;
+    }
+  put_word (o, len = strlen (s));
+  obstack_grow0 (o, s, len);
+  for (len++; len % WORDSIZE; len++)
+    obstack_1grow (o, '\0');
+}
+
+static void
+put_atat (struct obstack *o, struct atat const *atat)
+{
+  if (!atat)
+    {
+      put_word (o, NIL_WORD);
+      return;
+    }
+  put_word (o, atat->count);
+  put_word (o, atat->lno);
+  put_word (o, atat->line_count);
+  put_word (o, atat->lazy);
+  put_word (o, atat->beg);
+  for (size_t i = 0; i < atat->count; i++)
+    put_word (o, atat->holes[i]);
+}
+
+static void
+gcache_write_image (FILE *f, void const *data)
+{
+  struct cbuf const *image = data;
+
+  fwrite (image->string, 1, image->size, f);
+}
+
+static void
+gcache_save (struct repo const *repo, struct stat const *st)
+{
+  struct divvy *space = make_space ("gcache");
+  struct obstack *o = space->space;
+  struct cache_key key;
+  struct cbuf image;
+
+  cache_set_key (&key, GCACHE_MAGIC, GCACHE_VERSION, st);
+  obstack_grow (o, &key, sizeof (key));
+
+  put_string (o, repo->head);
+  put_string (o, repo->branch);
+
+  put_word (o, repo->access_count);
+  for (struct link *ls = repo->access; ls; ls = ls->next)
+    put_string (o, ls->entry);
+
+  put_word (o, repo->symbols_count);
+  for (struct link *ls = repo->symbols; ls; ls = ls->next)
+    {
+      struct symdef const *sym = ls->entry;
+
+      put_string (o, sym->meaningful);
+      put_string (o, sym->underlying);
+    }
+
+  put_word (o, repo->locks_count);
+  for (size_t i = 0; i < repo->locks_count; i++)
+    {
+      put_string (o, repo->lockdefs[i].login);
+      put_string (o, repo->lockdefs[i].revno);
+    }
+
+  put_word (o, repo->strict);
+  put_atat (o, repo->integrity);
+  put_atat (o, repo->comment);
+  put_word (o, repo->expand);
+
+  put_word (o, repo->deltas_count);
+  for (struct wlink *ls = repo->deltas; ls; ls = ls->next)
+    {
+      struct delta const *d = ls->entry;
+      size_t count = 0;
+
+      put_string (o, d->num);
+      put_string (o, d->date);
+      put_string (o, d->author);
+      put_string (o, d->state);
+      put_string (o, d->commitid);
+      put_string (o, d->ilk ? d->ilk->num : NULL);
+      for (struct wlink *br = d->branches; br; br = br->next)
+        count++;
+      put_word (o, count);
+      for (struct wlink *br = d->branches; br; br = br->next)
+        put_string (o, ((struct delta const *) br->entry)->num);
+      put_word (o, d->neck);
+      put_atat (o, d->log);
+      put_atat (o, d->text);
+    }
+
+  put_word (o, repo->neck);
+  put_atat (o, repo->desc);
+
+  image.size = obstack_object_size (o);
+  image.string = obstack_finish (o);
+
+  if (gmemo)
+    gmemo_put (image.string, image.size);
+  if (BE (grok_cache))
+    cache_write (gcache_filename (space, st), gcache_write_image, &image);
+  close_space (space);
+}
+
+struct gcache_reader
+{
+  char const *p;
+  char const *lim;
+  struct divvy *to;
+  struct fro *from;
+  bool bad;
+};
+
+static uint64_t
+get_word (struct gcache_reader *r)
+{
+  uint64_t w;
+
+  if (r->bad || (size_t) (r->lim - r->p) < WORDSIZE)
+    {
+      r->bad = true;
+      return NIL_WORD;
+    }
+  memcpy (&w, r->p, WORDSIZE);
+  r->p += WORDSIZE;
+  return w;
+}
+
+static size_t
+get_count (struct gcache_reader *r)
+/* Read a count, each element of which needs at least one word.  */
+{
+  uint64_t count = get_word (r);
+
+  if (count > (size_t) (r->lim - r->p) / WORDSIZE)
+    {
+      r->bad = true;
+      return 0;
+    }
+  return count;
+}
+
+static char const *
+get_string (struct gcache_reader *r)
+{
+  uint64_t len = get_word (r);
+  char const *s = r->p;
+
+  if (NIL_WORD == len || r->bad)
+    return NULL;
+  if (len >= (size_t) (r->lim - r->p)
+      || '\0' != s[len]
+      || PADDED (len + 1) > (size_t) (r->lim - r->p))
+    {
+      r->bad = true;
+      return NULL;
+    }
+  r->p += PADDED (len + 1);
+  return intern (r->to, s, len);
+}
+
+static struct atat *
+get_atat (struct gcache_reader *r)
+{
+  uint64_t count = get_word (r);
+  struct atat *atat;
+
+  if (NIL_WORD == count || r->bad)
+    return NULL;
+  if (! count || count + 4 > (size_t) (r->lim - r->p) / WORDSIZE)
+    {
+      r->bad = true;
+      return NULL;
+    }
+  atat = alloc (r->to, "atat", sizeof (struct atat)
+                + count * sizeof (off_t));
+  atat->count = count;
+  atat->lno = get_word (r);
+  atat->line_count = get_word (r);
+  atat->lazy = get_word (r);
+  atat->beg = get_word (r);
+  for (size_t i = 0; i < count; i++)
+    atat->holes[i] = get_word (r);
+  atat->from = r->from;
+  return atat;
+}
+
+static bool
+sdelim_at (struct fro *f, off_t pos)
+{
+  int c;
+
+  if (pos < 0 || f->end <= pos)
+    return false;
+  fro_move (f, pos);
+  GETCHAR_OR (c, f, return false);
+  return SDELIM == c;
+}
+
+static bool
+plausible_atat (struct fro *f, struct atat const *atat)
+{
+  return atat
+    && sdelim_at (f, atat->beg)
+    && sdelim_at (f, ATAT_END (atat));
+}
+
+static struct repo *
+gcache_decode (struct divvy *to, struct fro *f, struct stat const *st,
+               char const *buf, size_t size)
+/* Return the repo saved in the image ‘buf’ (‘size’ bytes) for
+   ‘f’ (whose status is ‘st’), or NULL if it does not apply.  */
+{
+  struct gcache_reader r = { .to = to, .from = f };
+  struct cache_key key, want;
+  struct repo *repo = NULL;
+  struct delta *last = NULL;
+  struct link box, *tp;
+  struct wlink wbox, *wtp;
+  size_t count;
+
+  if (size < sizeof (key))
+    return NULL;
+  cache_set_key (&want, GCACHE_MAGIC, GCACHE_VERSION, st);
+  memcpy (&key, buf, sizeof (key));
+  if (memcmp (&key, &want, sizeof (key)))
+    return NULL;
+  r.p = buf + sizeof (key);
+  r.lim = buf + size;
+
+  repo = empty_repo (to);
+  repo->ht = make_hash_table (to, NSLOTS);
+  repo->head = get_string (&r);
+  repo->branch = get_string (&r);
+
+#define PREP(field)  box.next = repo->field, tp = &box
+#define DONE(field)  repo->field = box.next, repo->field ## _count = count
+
+  count = get_count (&r);
+  PREP (access);
+  for (size_t i = 0; i < count; i++)
+    tp = extend (tp, get_string (&r), to);
+  DONE (access);
+
+  count = get_count (&r);
+  PREP (symbols);
+  for (size_t i = 0; i < count; i++)
+    {
+      struct symdef *sym = STRUCTALLOC (to, struct symdef);
+
+      sym->meaningful = get_string (&r);
+      sym->underlying = get_string (&r);
+      tp = extend (tp, sym, to);
+    }
+  DONE (symbols);
+
+#undef DONE
+#undef PREP
+
+  count = get_count (&r);
+  repo->locks_count = count;
+  repo->lockdefs = alloc (to, "locker definition",
+                          count * sizeof (struct lockdef));
+  for (size_t i = 0; i < count; i++)
+    {
+      repo->lockdefs[i].login = get_string (&r);
+      repo->lockdefs[i].revno = get_string (&r);
+    }
+
+  repo->strict = get_word (&r);
+  repo->integrity = get_atat (&r);
+  repo->comment = get_atat (&r);
+  repo->expand = get_word (&r);
+
+  /* First pass: create the deltas, remembering the ‘next’ and
+     ‘branches’ revnos in the ‘struct notyet’ for the second pass.  */
+  count = get_count (&r);
+  for (wbox.next = NULL, wtp = &wbox; count-- && !r.bad;)
+    {
+      struct notyet *ny = STRUCTALLOC (to, struct notyet);
+      struct delta *d = ny->d = zlloc (to, "delta", sizeof (struct delta));
+      size_t nbr;
+
+      ny->revno = d->num = get_string (&r);
+      d->tuple = make_revtuple (to, d->num);
+      d->date = get_string (&r);
+      d->author = get_string (&r);
+      d->state = get_string (&r);
+      d->commitid = get_string (&r);
+      ny->next = get_string (&r);
+      nbr = get_count (&r);
+      for (box.next = NULL, tp = &box; nbr--;)
+        tp = extend (tp, get_string (&r), to);
+      ny->branches = box.next;
+      d->neck = get_word (&r);
+      d->log = get_atat (&r);
+      d->text = get_atat (&r);
+      d->selector = true;
+      if (!d->num || !d->date || !d->author || !d->state
+          || !d->log || !d->text)
+        r.bad = true;
+      else
+        {
+          wtp = wextend (wtp, ny, to);
+          puthash (to, ny, repo->ht);
+          repo->deltas_count++;
+          last = d;
+        }
+    }
+  repo->deltas = wbox.next;
+
+  repo->neck = get_word (&r);
+  repo->desc = get_atat (&r);
+  if (r.bad || r.p != r.lim || !repo->desc)
+    goto bad;
+
+  /* Second pass: link the deltas.  */
+  for (struct wlink *ls = repo->deltas; ls; ls = ls->next)
+    {
+      struct notyet *ny = ls->entry, *deref;
+      struct delta *d = ny->d;
+      struct link *bls;
+      struct wlink bbox, *btp;
+
+      if (ny->next)
+        {
+          if (! (deref = FIND_NY (ny->next)))
+            goto bad;
+          d->ilk = deref->d;
+        }
+      for (bls = ny->branches, bbox.next = NULL, btp = &bbox;
+           bls;
+           bls = bls->next)
+        {
+          if (! (deref = FIND_NY (bls->entry)))
+            goto bad;
+          btp = wextend (btp, deref->d, to);
+        }
+      d->branches = bbox.next;
+      ls->entry = d;
+    }
+
+  /* Spot-check that ‘f’ looks like what we saved.  */
+  if (! plausible_atat (f, repo->desc)
+      || (last && ! plausible_atat (f, last->text)))
+    goto bad;
+  fro_move (f, f->end);
+
+  dangling_lockdefs (to, repo);
+  return repo;
+
+ bad:
+  fro_move (f, 0);
+  return NULL;
+}
+
+static struct repo *
+gcache_load (struct divvy *to, struct fro *f, struct stat const *st)
+{
+  struct divvy *space;
+  struct stat cst;
+  char const *image;
+  char *buf = NULL;
+  struct repo *repo = NULL;
+  size_t size;
+  int fd;
+
+  if (gmemo
+      && (image = gmemo_get (st, &size))
+      && (repo = gcache_decode (to, f, st, image, size)))
+    return repo;
+  if (! BE (grok_cache))
+    return NULL;
+
+  space = make_space ("gcache");
+  if (PROB (fd = cache_open (BE (grok_cache), gcache_filename (space, st),
+                             &cst)))
+    goto done;
+#if MMAP_SIGNAL
+  if (MAP_FAILED == (buf = mmap (NULL, cst.st_size, PROT_READ,
+                                 MAP_SHARED, fd, 0)))
+    {
+      buf = NULL;
+      goto done;
+    }
+#else  /* !MMAP_SIGNAL */
+  buf = alloc (space, "gcache", cst.st_size);
+  if (cst.st_size != read (fd, buf, cst.st_size))
+    goto done;
+#endif  /* !MMAP_SIGNAL */
+  repo = gcache_decode (to, f, st, buf, cst.st_size);
+  /* Promote it to the in-memory tier.  */
+  if (repo && gmemo)
+    gmemo_put (buf, cst.st_size);
+
+ done:
+#if MMAP_SIGNAL
+  if (buf)
+    munmap (buf, cst.st_size);
+#endif
+  if (! PROB (fd))
+    close (fd);
+  close_space (space);
+  return repo;
+}
+
 struct repo *
 grok_all (struct divvy *to, struct fro *f)
 {
-  struct repo *repo = full (to, f);
+  struct stat st;
+  bool cachep = (BE (grok_cache) || gmemo) && !PROB (fstat (f->fd, &st));
+  struct repo *repo = NULL;
 
+  if (cachep)
+    repo = gcache_load (to, f, &st);
+  if (! repo)
+    {
+      repo = full (to, f);
+      if (cachep)
+        gcache_save (repo, &st);
+    }
+  repo->index = index_deltas (to, repo);
   grok_resynch (repo);
   return repo;
 }
 
+struct delta *
+grok_delta (struct repo *repo, char const *revno)
+/* Return the delta whose revision number is exactly ‘revno’
+   (no leading zeros, no branch numbers), or NULL if ‘repo’ has
+   none such, or was not the result of ‘grok_all’.  Deltas added
+   since then (e.g., by ci(1)) are not found.  */
+{
+  struct delta **slot;
+
+  return repo && repo->index && (slot = index_slot (repo->index, revno))
+    ? *slot
+    : NULL;
+}
+
+void
+grok_forget (struct repo *repo, struct delta const *d)
+/* Drop ‘d’ from the index of ‘repo’, if present.  */
+{
+  struct delta **slot;
+
+  if (repo && repo->index
+      && (slot = index_slot (repo->index, d->num))
+      && d == *slot)
+    *slot = &gone;
+}
+
+struct symdef const *
+grok_symbol (struct repo *repo, char const *name, size_t len)
+/* Return the definition of the symbolic ‘name’ (‘len’ bytes, not
+   necessarily NUL-terminated) in ‘repo’, or NULL if there is none.  */
+{
+  struct link **slot = symindex_slot (symindex (repo), name, len);
+
+  return slot ? SYMDEF (*slot) : NULL;
+}
+
+void
+grok_symbol_set (struct repo *repo, struct symdef const *def)
+/* Make ‘def’ the definition of its name in ‘repo’, replacing the
+   current one in place, or else prepending it to ‘repo->symbols’.  */
+{
+  struct symindex *ix = symindex (repo);
+  struct link **slot = SYMSLOT (ix, def->meaningful);
+
+  if (slot)
+    {
+      (*slot)->entry = def;
+      return;
+    }
+  repo->symbols = prepend (def, repo->symbols, SINGLE);
+  if (2 * (1 + ix->count) > 1 + ix->mask)
+    symindex_resize (ix, 1 + ix->count);
+  symindex_put (ix, repo->symbols);
+}
+
+bool
+grok_symbol_unset (struct repo *repo, char const *name)
+/* Remove the definition of ‘name’ from ‘repo’.
+   Return false if there was none.  */
+{
+  struct symindex *ix = symindex (repo);
+  struct link **slot = SYMSLOT (ix, name), *ls, *next;
+
+  if (!slot)
+    return false;
+  ls = *slot;
+  *slot = &gone_sym;
+  if ((next = ls->next))
+    {
+      struct link **nslot = SYMSLOT (ix, SYMDEF (next)->meaningful);
+
+      /* Move ‘next’ into ‘ls’, and point its slot there.  */
+      ls->entry = next->entry;
+      ls->next = next->next;
+      if (nslot && next == *nslot)
+        *nslot = ls;
+    }
+  else
+    {
+      struct link box, *tp;
+
+      for (box.next = repo->symbols, tp = &box; tp->next != ls; tp = tp->next)
+        continue;
+      tp->next = NULL;
+      repo->symbols = box.next;
+    }
+  if (ix->dups)
+    /* Uncover a later definition of the same name, if any.  */
+    for (ls = repo->symbols; ls; ls = ls->next)
+      if (STR_SAME (name, SYMDEF (ls)->meaningful))
+        {
+          if (2 * (1 + ix->count) > 1 + ix->mask)
+            symindex_resize (ix, 1 + ix->count);
+          symindex_put (ix, ls);
+          break;
+        }
+  return true;
+}
+
 void
 grok_resynch (struct repo *repo)
 /* (Re-)initialize the appropriate global variables.  */
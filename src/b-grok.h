@@ -18,8 +18,35 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/* The header of a cache file: all 8-byte words in host byte order.  */
+struct cache_key
+{
+  uint64_t magic, version, dev, ino, size;
+  uint64_t mtime, mtime_ns, ctime, ctime_ns;
+};
+
+extern void cache_set_key (struct cache_key *key, char const *magic,
+                           uint64_t version, struct stat const *st);
+extern int cache_open (char const *dir, char const *filename,
+                       struct stat *st);
+extern off_t cache_write (char const *filename,
+                          void (*writer) (FILE *f, void const *data),
+                          void const *data);
+
+struct gmemo;
+extern THREAD_LOCAL struct gmemo *gmemo;
+extern struct gmemo *make_gmemo (size_t limit);
+extern bool gmemo_head (struct stat const *st, struct cbuf *text);
+extern void gmemo_put_head (struct stat const *st, struct cbuf text);
+
 extern struct repo *empty_repo (struct divvy *to);
 extern struct repo *grok_all (struct divvy *to, struct fro *f);
 extern void grok_resynch (struct repo *repo);
+extern struct delta *grok_delta (struct repo *repo, char const *revno);
+extern void grok_forget (struct repo *repo, struct delta const *d);
+extern struct symdef const *grok_symbol (struct repo *repo,
+                                         char const *name, size_t len);
+extern void grok_symbol_set (struct repo *repo, struct symdef const *def);
+extern bool grok_symbol_unset (struct repo *repo, char const *name);
 
 /* b-grok.h ends here */
@@ -126,6 +126,8 @@ catchsigaction (int signo, siginfo_t *info, RCS_UNUSED void *uc)
     }
 
   ignore (scratch);
+  /* A signal ends the process, even for a nested invocation.  */
+  bail_out = NULL;
   setrid ();
   if (!*ISR (be_quiet))
     {
@@ -0,0 +1,199 @@
+/* b-jobs.c --- process files with several worker processes
+
+   Copyright (C) 2010-2012 Thien-Thi Nguyen
+
+   This file is part of GNU RCS.
+
+   GNU RCS is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU RCS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty
+   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+   See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "same-inode.h"
+#include "b-complain.h"
+#include "b-divvy.h"
+#include "b-fb.h"
+#include "b-jobs.h"
+
+struct job
+{
+  pid_t pid;
+  FILE *out;
+  FILE *err;
+  /* Where the worker's standard output and standard error go.
+     If ours are the same file, ‘err’ is NULL and ‘out’ takes both.  */
+};
+
+/* Set in a worker process.  */
+static THREAD_LOCAL bool worker;
+
+/* A worker that ends with a fatal error (see ‘jobs_fatal’) adds this
+   to its exit value, so that the parent can tell that it stopped
+   before the end of its share.  */
+#define FATAL_BIT  0x40
+
+static void
+relay (FILE *from, int to)
+/* Copy the contents of temporary file ‘from’ to fd ‘to’,
+   then close ‘from’.  */
+{
+  char buf[BUFSIZ];
+  ssize_t count, w;
+  int fd = fileno (from);
+
+  if (PROB (lseek (fd, 0, SEEK_SET)))
+    fatal_sys ("temporary file");
+  while (0 < (count = read (fd, buf, sizeof buf)))
+    for (char const *p = buf; count; count -= w, p += w)
+      if (PROB (w = write (to, p, count)))
+        {
+          if (EINTR != errno)
+            Oerror ();
+          w = 0;
+        }
+  if (PROB (count))
+    fatal_sys ("temporary file");
+  fclose (from);
+}
+
+bool
+jobs_split (int *argc, char ***argv, int *exitstatus)
+/* If ‘BE (jobs)’ calls for it, divide the ‘*argc’ filenames in ‘*argv’
+   into contiguous shares (keeping pairs together, see ‘pair_span’),
+   and fork a worker process for each.  In a worker, set ‘*argc’ and
+   ‘*argv’ to its share and return false; the caller should process
+   those files as usual, and call ‘jobs_done’ at the end.  The parent
+   waits for each worker in turn, copies its standard error and standard
+   output to ours (so that the output is in the same order as for serial
+   processing), raises ‘*exitstatus’ to the worst exit value, and
+   returns true; the caller should skip the files.  Otherwise (serial
+   processing), return false.  If our standard output and standard
+   error are the same file, a worker writes both to one place, so that
+   their interleaving is kept, too.  If a worker ends with a fatal
+   error, which in serial processing would have stopped the files
+   after it, the parent terminates the later workers and discards
+   their output.  */
+{
+  int n = *argc, units = 0, count;
+  char **v = *argv;
+  struct job *jobs;
+  struct stat outst, errst;
+  bool together, stop = false;
+
+  /* Workers cannot ask questions (their stdin is /dev/null).  */
+  if (BE (jobs) < 2 || ttystdin ())
+    return false;
+  for (int i = 0; i < n; i += pair_span (n - i, v + i))
+    units++;
+  if (units < 2)
+    return false;
+  count = BE (jobs) < units ? BE (jobs) : units;
+  jobs = alloc (PLEXUS, "jobs", count * sizeof (struct job));
+  together = !PROB (fstat (STDOUT_FILENO, &outst))
+    && !PROB (fstat (STDERR_FILENO, &errst))
+    && SAME_INODE (outst, errst);
+
+  fflush (stdout);
+  fflush (stderr);
+  for (int k = 0, i = 0, u = 0; k < count; k++)
+    {
+      struct job *j = jobs + k;
+      int beg = i, end = (k + 1) * units / count;
+
+      for (; u < end; u++)
+        i += pair_span (n - i, v + i);
+      j->err = NULL;
+      if (! (j->out = tmpfile ())
+          || ! (together || (j->err = tmpfile ())))
+        fatal_sys ("temporary file");
+      if (PROB (j->pid = fork ()))
+        fatal_sys ("fork");
+      if (! j->pid)
+        {
+          int fd = open ("/dev/null", O_RDONLY);
+
+          if (PROB (fd)
+              || PROB (dup2 (fd, STDIN_FILENO))
+              || PROB (dup2 (fileno (j->out), STDOUT_FILENO))
+              || PROB (dup2 (fileno (j->err ? j->err : j->out),
+                             STDERR_FILENO)))
+            _Exit (EXIT_FAILURE);
+          close (fd);
+          worker = true;
+          /* A fatal error ends the worker, not some nesting caller.  */
+          bail_out = NULL;
+          *argc = i - beg;
+          *argv = v + beg;
+          return false;
+        }
+    }
+
+  for (int k = 0; k < count; k++)
+    {
+      struct job *j = jobs + k;
+      int status;
+
+      if (stop)
+        kill (j->pid, SIGTERM);
+      while (PROB (waitpid (j->pid, &status, 0)))
+        if (EINTR != errno)
+          fatal_sys ("waitpid");
+      if (stop)
+        {
+          if (j->err)
+            fclose (j->err);
+          fclose (j->out);
+          continue;
+        }
+      if (j->err)
+        relay (j->err, STDERR_FILENO);
+      relay (j->out, STDOUT_FILENO);
+      status = WIFEXITED (status)
+        ? WEXITSTATUS (status)
+        : EXIT_FAILURE;
+      if (status & FATAL_BIT)
+        {
+          stop = true;
+          status &= ~FATAL_BIT;
+        }
+      if (*exitstatus < status)
+        *exitstatus = status;
+    }
+  return true;
+}
+
+int
+jobs_fatal (int exitval)
+/* Return the value with which to end the process, instead of
+   ‘exitval’, after a fatal error.  */
+{
+  return worker
+    ? FATAL_BIT | exitval
+    : exitval;
+}
+
+void
+jobs_done (int exitstatus)
+/* If this is a worker process, exit with ‘exitstatus’.  */
+{
+  if (worker)
+    exit (exitstatus);
+}
+
+/* b-jobs.c ends here */
@@ -0,0 +1,25 @@
+/* b-jobs.h --- process files with several worker processes
+
+   Copyright (C) 2010-2012 Thien-Thi Nguyen
+
+   This file is part of GNU RCS.
+
+   GNU RCS is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU RCS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty
+   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+   See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+extern bool jobs_split (int *argc, char ***argv, int *exitstatus);
+extern void jobs_done (int exitstatus);
+extern int jobs_fatal (int exitval);
+
+/* b-jobs.h ends here */
@@ -29,8 +29,8 @@
 #include "b-kwxout.h"
 
 static void
-escape_string (register FILE *out, register char const *s)
-/* Output to ‘out’ the string ‘s’,
+escape_string (struct divvy *space, register char const *s)
+/* Accumulate in ‘space’ the string ‘s’,
    escaping chars that would break ‘ci -k’.  */
 {
   register char c;
@@ -41,120 +41,148 @@ escape_string (register FILE *out, register char const *s)
       case 0:
         return;
       case '\t':
-        aputs ("\\t", out);
+        accs (space, "\\t");
         break;
       case '\n':
-        aputs ("\\n", out);
+        accs (space, "\\n");
         break;
       case ' ':
-        aputs ("\\040", out);
+        accs (space, "\\040");
         break;
       case KDELIM:
-        aputs ("\\044", out);
+        accs (space, "\\044");
         break;
       case '\\':
         if (VERSION (5) <= BE (version))
           {
-            aputs ("\\\\", out);
+            accs (space, "\\\\");
             break;
           }
         /* fall into */
       default:
-        aputc (c, out);
+        accumulate_byte (space, c);
         break;
       }
 }
 
-static void
-keyreplace (struct pool_found *marker, struct expctx *ctx)
-/* Output the keyword value(s) corresponding to ‘marker’.
-   Attributes are derived from ‘delta’.  */
+static struct cbuf
+keyword_value (struct pool_found *marker, struct expctx *ctx)
+/* Return the expansion of the keyword ‘marker’, from ‘$’ to ‘$’
+   (or just the value, for ‘kwsub_v’), but not the log for ‘Log’.
+   Attributes are derived from ‘ctx->delta’.  They do not change
+   during an expansion, so compute each keyword's expansion only
+   once, keeping it in ‘ctx->vspace’.  */
 {
-  struct fro *infile = ctx->from;
-  register FILE *out = ctx->to;
-  register struct delta const *delta = ctx->delta;
-  bool dolog = ctx->dolog, delimstuffed = ctx->delimstuffed;
-  register char const *sp, *cp, *date;
-  int c;
-  register size_t cs, cw, ls;
-  char const *sp1;
+  struct cbuf *value = &ctx->value[marker->i];
+  struct delta const *delta = ctx->delta;
+  char const *date = delta->date;
   char datebuf[datesize + zonelenmax];
-  int RCSv;
-  int exp;
+  int RCSv = BE (version);
+  int exp = BE (kws);
   bool include_locker = BE (inclusive_of_Locker_in_Id_val);
+  struct divvy *space;
 
-  exp = BE (kws);
-  date = delta->date;
-  RCSv = BE (version);
+  if (value->string)
+    return *value;
+  if (!ctx->vspace)
+    ctx->vspace = make_space ("kwvalues");
+  space = ctx->vspace;
 
   if (exp != kwsub_v)
-    aprintf (out, "%c%s", KDELIM, marker->sym->bytes);
+    accf (space, "%c%s", KDELIM, marker->sym->bytes);
   if (exp != kwsub_k)
     {
       if (exp != kwsub_v)
-        aprintf (out, "%c%c", VDELIM,
-                 marker->i == Log && RCSv < VERSION (5) ? '\t' : ' ');
+        accf (space, "%c%c", VDELIM,
+              marker->i == Log && RCSv < VERSION (5) ? '\t' : ' ');
 
       switch (marker->i)
         {
         case Author:
-          aputs (delta->author, out);
+          accs (space, delta->author);
           break;
         case Date:
-          aputs (date2str (date, datebuf), out);
+          accs (space, date2str (date, datebuf));
           break;
         case Id:
         case Header:
-          escape_string (out,
+          escape_string (space,
                          marker->i == Id || RCSv < VERSION (4)
                          ? basefilename (REPO (filename)) : getfullRCSname ());
-          aprintf (out, " %s %s %s %s",
-                   delta->num,
-                   date2str (date, datebuf),
-                   delta->author,
-                   RCSv == VERSION (3) && delta->lockedby ? "Locked"
-                   : delta->state);
+          accf (space, " %s %s %s %s",
+                delta->num,
+                date2str (date, datebuf),
+                delta->author,
+                RCSv == VERSION (3) && delta->lockedby ? "Locked"
+                : delta->state);
           if (delta->lockedby)
             {
               if (VERSION (5) <= RCSv)
                 {
                   if (include_locker || exp == kwsub_kvl)
-                    aprintf (out, " %s", delta->lockedby);
+                    accf (space, " %s", delta->lockedby);
                 }
               else if (RCSv == VERSION (4))
-                aprintf (out, " Locker: %s", delta->lockedby);
+                accf (space, " Locker: %s", delta->lockedby);
             }
           break;
         case Locker:
           if (delta->lockedby)
             if (include_locker || exp == kwsub_kvl || RCSv <= VERSION (4))
-              aputs (delta->lockedby, out);
+              accs (space, delta->lockedby);
           break;
         case Log:
         case RCSfile:
-          escape_string (out, basefilename (REPO (filename)));
+          escape_string (space, basefilename (REPO (filename)));
           break;
         case Name:
           if (delta->name)
-            aputs (delta->name, out);
+            accs (space, delta->name);
           break;
         case Revision:
-          aputs (delta->num, out);
+          accs (space, delta->num);
           break;
         case Source:
-          escape_string (out, getfullRCSname ());
+          escape_string (space, getfullRCSname ());
           break;
         case State:
-          aputs (delta->state, out);
+          accs (space, delta->state);
           break;
         default:
           break;
         }
       if (exp != kwsub_v)
-        afputc (' ', out);
+        accumulate_byte (space, ' ');
     }
   if (exp != kwsub_v)
-    afputc (KDELIM, out);
+    accumulate_byte (space, KDELIM);
+  /* Avoid ‘finish_string’ on an empty object (for ‘kwsub_v’).  */
+  accumulate_byte (space, '\0');
+  value->string = finish_string (space, &value->size);
+  value->size--;
+  return *value;
+}
+
+static void
+keyreplace (struct pool_found *marker, struct expctx *ctx)
+/* Output the keyword value(s) corresponding to ‘marker’.
+   Attributes are derived from ‘delta’.  */
+{
+  struct fro *infile = ctx->from;
+  register FILE *out = ctx->to;
+  register struct delta const *delta = ctx->delta;
+  bool dolog = ctx->dolog, delimstuffed = ctx->delimstuffed;
+  register char const *sp, *cp, *date;
+  int c;
+  register size_t cs, cw, ls;
+  char const *sp1;
+  char datebuf[datesize + zonelenmax];
+  int RCSv;
+  struct cbuf value = keyword_value (marker, ctx);
+
+  date = delta->date;
+  RCSv = BE (version);
+  awrite (value.string, value.size, out);
 
   if (marker->i == Log && dolog)
     {
@@ -172,7 +200,7 @@ keyreplace (struct pool_found *marker, struct expctx *ctx)
       else
         {
           bool kdelim_found = false;
-          off_t chars_read = fro_tello (infile);
+          off_t chars_read = fro_tello (infile) - ctx->beg;
 
           c = 0;                /* Pacify ‘gcc -Wall’.  */
 
@@ -296,6 +324,36 @@ keyreplace (struct pool_found *marker, struct expctx *ctx)
     }
 }
 
+static bool
+plain_run (struct expctx *ctx)
+/* If ‘ctx->from’ is in memory, copy the bytes up to (but not including)
+   the next newline, ‘KDELIM’ or (if ‘ctx->delimstuffed’) ‘SDELIM’,
+   all at once, to ‘ctx->to’ (and ‘ctx->rewr’, if set), and skip them.
+   Return true if any bytes were copied.  */
+{
+  struct fro *fin = ctx->from;
+  char const *p = fin->ptr, *stop, *x;
+  size_t len;
+
+  if (STDIO_P (fin) || p == fin->lim)
+    return false;
+  stop = memchr (p, '\n', fin->lim - p);
+  if (!stop)
+    stop = fin->lim;
+  if ((x = memchr (p, KDELIM, stop - p)))
+    stop = x;
+  if (ctx->delimstuffed
+      && (x = memchr (p, SDELIM, stop - p)))
+    stop = x;
+  if (! (len = stop - p))
+    return false;
+  awrite (p, len, ctx->to);
+  if (ctx->rewr)
+    awrite (p, len, ctx->rewr);
+  fin->ptr += len;
+  return true;
+}
+
 int
 expandline (struct expctx *ctx)
 /* Read a line from ‘ctx->from’ and write it to ‘ctx->to’.  Do keyword
@@ -330,6 +388,8 @@ expandline (struct expctx *ctx)
   for (;;)
     {
 #define GETCHAR_ELSE_GOTO(label)  GETCHAR_OR (c, fin, goto label);
+      if (plain_run (ctx))
+        r = 0;
       if (delimstuffed)
         TEECHAR ();
       else
@@ -26,9 +26,18 @@ struct expctx
   struct delta const *delta;
   const bool delimstuffed, dolog;
 
+  /* Position in ‘from’ where the text begins (usually 0); when looking
+     for the comment leader of ‘$Log’, don't back up past it.  */
+  off_t beg;
+
   /* Some space to (temporarily) hold key/value/line fragments
      (for kwxout-internal use; not set by callers).  */
   struct divvy *lparts;
+
+  /* Expansion of each keyword, computed on first use and
+     held in ‘vspace’ (also kwxout-internal).  */
+  struct divvy *vspace;
+  struct cbuf value[State + 1];
 };
 
 /* Idioms.  Note that .delta is hardcoded ‘delta’.  */
@@ -50,6 +59,8 @@ struct expctx
     {                                           \
       if ((ctx)->lparts)                        \
         close_space ((ctx)->lparts);            \
+      if ((ctx)->vspace)                        \
+        close_space ((ctx)->vspace);            \
     }                                           \
   while (0)
 
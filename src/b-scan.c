@@ -0,0 +1,120 @@
+/* b-scan.c --- finding ‘SDELIM’ in bulk
+
+   Copyright (C) 2010-2012 Thien-Thi Nguyen
+
+   This file is part of GNU RCS.
+
+   GNU RCS is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU RCS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty
+   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+   See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base.h"
+#include <string.h>
+#include "b-fb.h"
+#include "b-scan.h"
+
+/* If the compiler targets a vector instruction set we know about,
+   use it to look for ‘SDELIM’ and '\n' at the same time, a block at
+   a time.  Otherwise, fall back to ‘memchr’.  */
+
+#if defined __GNUC__ && defined __AVX2__
+#include <immintrin.h>
+#define BLOCK             32
+typedef __m256i vec_t;
+typedef uint32_t mask_t;
+#define SPLAT(c)          _mm256_set1_epi8 (c)
+#define LOAD(p)           _mm256_loadu_si256 ((vec_t const *) (p))
+#define MATCH(v,c)        ((mask_t) _mm256_movemask_epi8 \
+                           (_mm256_cmpeq_epi8 (v, c)))
+#elif defined __GNUC__ && defined __SSE2__
+#include <emmintrin.h>
+#define BLOCK             16
+typedef __m128i vec_t;
+typedef uint32_t mask_t;
+#define SPLAT(c)          _mm_set1_epi8 (c)
+#define LOAD(p)           _mm_loadu_si128 ((vec_t const *) (p))
+#define MATCH(v,c)        ((mask_t) _mm_movemask_epi8 \
+                           (_mm_cmpeq_epi8 (v, c)))
+#else
+#define BLOCK             0
+#endif
+
+static size_t
+count_newlines (char const *p, char const *lim)
+{
+  size_t count = 0;
+
+  while ((p = memchr (p, '\n', lim - p)))
+    p++, count++;
+  return count;
+}
+
+char const *
+scan_sdelim (char const *p, char const *lim, size_t *newlines)
+/* Return the address of the first ‘SDELIM’ in [p,lim), or ‘lim’ if
+   there is none.  If ‘newlines’ is non-NULL, add to ‘*newlines’ the
+   number of '\n' between ‘p’ and the returned address.  */
+{
+  char const *at;
+
+#if BLOCK
+  if (newlines)
+    {
+      vec_t const sdelim = SPLAT (SDELIM);
+      vec_t const nl = SPLAT ('\n');
+      size_t count = 0;
+
+      for (; BLOCK <= lim - p; p += BLOCK)
+        {
+          vec_t v = LOAD (p);
+          mask_t am = MATCH (v, sdelim);
+          mask_t nm = MATCH (v, nl);
+
+          if (am)
+            {
+              int i = __builtin_ctz (am);
+
+              count += __builtin_popcount (nm & ((1U << i) - 1));
+              *newlines += count;
+              return p + i;
+            }
+          count += __builtin_popcount (nm);
+        }
+      *newlines += count;
+    }
+#endif  /* BLOCK */
+
+  if (! (at = memchr (p, SDELIM, lim - p)))
+    at = lim;
+  if (newlines)
+    *newlines += count_newlines (p, at);
+  return at;
+}
+
+void
+stuff_sdelim (FILE *to, char const *p, size_t len)
+/* Write ‘len’ bytes starting at ‘p’ to ‘to’, doubling each ‘SDELIM’.  */
+{
+  char const *lim = p + len;
+  char const *at;
+
+  while ((at = scan_sdelim (p, lim, NULL)) < lim)
+    {
+      awrite (p, at + 1 - p, to);
+      aputc (SDELIM, to);
+      p = at + 1;
+    }
+  awrite (p, lim - p, to);
+}
+
+/* b-scan.c ends here */
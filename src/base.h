@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <setjmp.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -244,6 +245,9 @@ struct delta
   /* Pointer to revision number (ASCIZ).  */
   char const *num;
 
+  /* The fields of ‘num’ as integers, or NULL if not known.  */
+  struct revtuple const *tuple;
+
   /* Pointer to date of checkin, person checking in, the locker.  */
   char const *date;
   char const *author;
@@ -282,6 +286,13 @@ struct delta
   off_t neck;
 };
 
+/* A revision number, pre-parsed for quick comparison.  */
+struct revtuple
+{
+  size_t count;
+  unsigned long field[];
+};
+
 /* List element for locks.  */
 struct rcslock
 {
@@ -393,7 +404,7 @@ struct program
 };
 
 /* (Somewhat) fleeting files.  */
-enum maker { notmade, real, effective };
+enum maker { notmade, real, effective, anonymous };
 
 struct sff
 {
@@ -401,6 +412,9 @@ struct sff
   /* Unlink this when done.  */
   enum maker disposition;
   /* (But only if it is in the right mood.)  */
+  int fd;
+  /* If ‘disposition’ is ‘anonymous’, there is nothing to unlink;
+     ‘filename’ refers to this open descriptor, to close instead.  */
 };
 
 /* A program controls the behavior of subsystems by setting these.
@@ -522,6 +536,48 @@ struct behavior
      Set by env var ‘RCS_MEM_LIMIT’.
      -- gnurcs_init  */
 
+  char const *grok_cache;
+  /* If non-NULL, the directory in which to keep parsed-header caches
+     of RCS files, to avoid re-parsing them if unchanged.
+     Set by env var ‘RCS_GROK_CACHE’.
+     -- gnurcs_init grok_all  */
+
+  char const *rev_cache;
+  /* If non-NULL, the directory in which to keep the text of revisions
+     built from more than one delta, to avoid building them again.
+     Set by env var ‘RCS_CACHE_DIR’.
+     -- gnurcs_init buildrevision  */
+
+  off_t rev_cache_size;
+  /* When the files in ‘rev_cache’ total more than this many kilobytes,
+     remove the least recently used ones.
+     Set by env var ‘RCS_CACHE_SIZE’.
+     -- gnurcs_init buildrevision  */
+
+  bool external_diff;
+  /* Compute delta texts by running diff(1), instead of in-process.
+     Set by env var ‘RCS_EXTERNAL_DIFF’.
+     -- gnurcs_init [ci]main buildeltatext  */
+
+  long jobs;
+  /* Process the files named on the command line with this many
+     worker processes (1 means serially, in this process).
+     Set by env var ‘RCS_JOBS’.
+     -- gnurcs_init jobs_split  */
+
+  bool trace;
+  /* Report each child process (program, status, wall time) and,
+     at the end, how many were run, on stderr.
+     Set by env var ‘RCS_TRACE’.
+     -- gnurcs_init reap_child gnurcs_goodbye  */
+
+  unsigned long children;
+  /* How many child processes ‘spawn’ has started.  */
+
+  long children_msecs;
+  /* Total wall time, in milliseconds, that ‘reap_child’ has measured
+     for those children (only if ‘trace’).  */
+
   struct sff *sff;
   /* (Somewhat) fleeting files.  */
 
@@ -544,6 +600,10 @@ struct manifestation
   /* [co] Use this if writing to stdout.  */
   FILE *standard_output;
 
+  /* [ci co] The working file being written, or NULL.
+     -- [ci]xpandfile [co]main  */
+  FILE *newwork;
+
   /* Previous keywords, to accomodate ‘ci -k’.
      -- getoldkeys  */
   struct {
@@ -577,6 +637,10 @@ struct repo
   struct link *symbols;
   /* List of symbolic name definitions (struct symdef).  */
 
+  struct symindex *symindex;
+  /* Symbolic name to definition, or NULL if not yet needed.
+     -- grok_symbol grok_symbol_set grok_symbol_unset  */
+
   size_t locks_count;
   struct link *locks;
   /* List of locks (struct rcslock).  */
@@ -597,6 +661,10 @@ struct repo
   struct wlink *deltas;
   /* List of deltas (struct delta).  */
 
+  struct revindex *index;
+  /* Revision number to delta, or NULL.
+     -- grok_all grok_delta grok_forget  */
+
   struct atat *desc;
   /* Description of the RCS file.  */
 
@@ -669,6 +737,10 @@ struct flow
   /* True means some (parsing/merging) error was encountered.
      The program should clean up temporary files and exit.
      -- buildjoin syserror generic_error generic_fatal  */
+
+  struct fro *opened;
+  /* The ‘struct fro’s not yet closed, most recently opened first.
+     -- fro_open fro_membuf fro_close fro_abandon_all  */
 };
 
 /* The top of the structure tree.  */
@@ -681,7 +753,52 @@ struct top
   struct flow flow;
 };
 
-extern struct top *top;
+extern THREAD_LOCAL struct top *top;
+
+/* Everything that ‘gnurcs_init’ sets up (and ‘gnurcs_goodbye’ tears
+   down) hangs off ‘top’, ‘single’ and ‘plexus’.  These are per-thread,
+   so that each thread can process RCS files independently of the
+   others.  To nest a complete invocation in the same thread (e.g.,
+   for internal dispatch), save them in a ‘struct dynamic_root’ with
+   ‘droot_global_to_stack’ and restore them afterwards with
+   ‘droot_stack_to_global’.  */
+struct dynamic_root
+{
+  struct top *top;
+  struct divvy *single;
+  struct divvy *plexus;
+  /* FIXME: What about these?
+     - program_invocation_name
+     - program_invocation_short_name
+     - stderr
+     - stdin
+     - stdout
+     (These are from "nm --defined-only -D grcs".)  */
+};
+
+/* Normally, ‘thank_you_and_goodnight’ and ‘gnurcs_exit’ end the
+   process.  If ‘bail_out’ is non-NULL, they instead record the exit
+   value in it and ‘longjmp’ to its ‘where’.  This lets a caller that
+   nests a complete invocation (e.g., "grcs batch") survive a fatal
+   error in it.  It is the caller's responsibility to tear down the
+   nested dynamic root afterwards.  */
+struct bail_out
+{
+  jmp_buf where;
+  int exitval;
+};
+
+extern THREAD_LOCAL struct bail_out *bail_out;
+
+/* A child process started by ‘spawn’.  Several can run at once;
+   each must eventually be passed to ‘reap_child’.  */
+struct child
+{
+  pid_t pid;
+  int wstatus;
+  char const *name;
+  struct timespec start;
+};
 
 /* In the future we might move ‘top’ into another structure.
    These abstractions keep the invasiveness to a minimum.  */
@@ -724,12 +841,16 @@ char const *kwsub_string (enum kwsub i);
 bool recognize_keyword (char const *string, struct pool_found *found);
 
 /* merger */
+int merge_texts (struct divvy *space, struct cbuf *result,
+                 char const *edarg, char const *label[3],
+                 struct cbuf const text[3]);
 int merge (bool tostdout, char const *edarg,
            struct symdef three_manifestations[3]);
 
 /* rcsedit */
 struct editstuff *make_editstuff (void);
 void unmake_editstuff (struct editstuff *es);
+struct editstuff *clone_editstuff (struct editstuff *es);
 int un_link (char const *s);
 void openfcopy (FILE *f);
 void finishedit (struct editstuff *es, struct delta const * delta,
@@ -737,8 +858,7 @@ void finishedit (struct editstuff *es, struct delta const * delta,
 void snapshotedit (struct editstuff *es, FILE *f);
 void copystring (struct editstuff *es, struct atat *atat);
 void enterstring (struct editstuff *es, struct atat *atat);
-void editstring (struct editstuff *es, struct atat const *script,
-                 struct delta const *delta);
+void editstring (struct editstuff *es, struct atat const *script);
 struct fro *rcswriteopen (struct maybe *m);
 int chnamemod (FILE **fromp, char const *from, char const *to,
                int set_mode, mode_t mode, time_t mtime);
@@ -758,12 +878,13 @@ int getdiffcmd (struct fro *finfile, bool delimiter,
 
 /* rcsfcmp */
 int rcsfcmp (struct fro *xfp, struct stat const *xstatp,
-             char const *uname, struct delta const *delta);
+             struct fro *ufp, struct delta const *delta);
 
 /* rcsfnms */
 char const *basefilename (char const *p);
 char const *rcssuffix (char const *name);
 struct fro *rcsreadopen (struct maybe *m);
+int pair_span (int argc, char **argv);
 int pairnames (int argc, char **argv, open_rcsfile_fn *rcsopen,
                bool mustread, bool quiet);
 char const *getfullRCSname (void);
@@ -773,6 +894,12 @@ bool isSLASH (int c);
 char const *buildrevision (struct wlink const *deltas,
                            struct delta *target,
                            FILE *outfile, bool expandflag);
+struct fro *buildrevision_fro (struct wlink const *deltas,
+                               struct delta *target,
+                               bool expandflag, off_t sizehint);
+void buildrevisions (size_t count, struct delta *target[count],
+                     FILE *outfile[count], bool expandflag);
+bool chain_has_kdelim (struct wlink const *chain);
 struct cbuf cleanlogmsg (char const *m, size_t s);
 bool ttystdin (void);
 int getcstdin (void);
@@ -790,6 +917,8 @@ bool putdtext (struct delta const *delta, char const *srcname,
 void putstring (FILE *out, bool delim, struct cbuf s, bool log);
 void putdftext (struct delta const *delta, struct fro *finfile,
                 FILE *foutfile, bool diffmt);
+void putddtext (struct delta const *delta, struct fro *from, struct fro *to,
+                FILE *fout);
 
 /* rcskeep */
 bool getoldkeys (struct fro *fp);
@@ -808,6 +937,10 @@ int cmpnum (char const *num1, char const *num2);
 int cmpnumfld (char const *num1, char const *num2, int fld);
 int cmpdate (char const *d1, char const *d2);
 int compartial (char const *num1, char const *num2, int length);
+struct revtuple *make_revtuple (struct divvy *to, char const *num);
+int cmptuple (struct revtuple const *a, struct revtuple const *b,
+              size_t length);
+int cmpdelta (struct delta const *a, struct delta const *b);
 struct delta *genrevs (char const *revno, char const *date,
                        char const *author, char const *state,
                        struct wlink **store);
@@ -837,9 +970,12 @@ void thank_you_and_goodnight (int const how)
 
 void gnurcs_init (struct program const *program);
 void gnurcs_goodbye (void);
+void gnurcs_exit (int exitval)
+  exiting;
+void droot_global_to_stack (struct dynamic_root *dr);
+void droot_stack_to_global (struct dynamic_root *dr);
 void bad_option (char const *option);
 void redefined (int c);
-struct cbuf minus_p (char const *xrev, char const *rev);
 void parse_revpairs (char option, char *arg, void *data,
                      void (*put) (char const *b, char const *e,
                                   bool sawsep, void *data));
@@ -848,6 +984,9 @@ void ffree (void);
 char *str_save (char const *s);
 char *cgetenv (char const *name);
 void awrite (char const *buf, size_t chars, FILE *f);
+void spawn (struct child *kid, int infd, char const *outname,
+            char const **args);
+int reap_child (struct child *kid);
 int runv (int infd, char const *outname, char const **args);
 int run (int infd, char const *outname, ...);
 void setRCSversion (char const *str);
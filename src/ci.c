@@ -37,6 +37,7 @@
 #include "b-fro.h"
 #include "b-grok.h"
 #include "b-isr.h"
+#include "b-jobs.h"
 #include "b-kwxout.h"
 
 /* Work around a common ‘ftruncate’ bug: NFS won't let you truncate a file
@@ -58,7 +59,6 @@ struct work
 {
   struct stat st;
   struct fro *fro;
-  FILE *ex;                             /* expansion */
 };
 
 struct bud                              /* new growth */
@@ -78,7 +78,7 @@ cleanup (int *exitstatus, struct work *work)
     *exitstatus = EXIT_FAILURE;
   fro_zclose (&FLOW (from));
   fro_zclose (&work->fro);
-  Ozclose (&work->ex);
+  Ozclose (&MANI (newwork));
   Ozclose (&FLOW (res));
   ORCSclose ();
   dirtempunlink ();
@@ -495,7 +495,7 @@ xpandfile (struct work *work, struct delta const *delta,
   int e, r;
 
   targetname = makedirtemp (true);
-  if (!(work->ex = fopen_safer (targetname, FOPEN_W_WORK)))
+  if (!(MANI (newwork) = fopen_safer (targetname, FOPEN_W_WORK)))
     {
       syserror_errno (targetname);
       MERR ("can't build working file");
@@ -503,10 +503,11 @@ xpandfile (struct work *work, struct delta const *delta,
     }
   r = 0;
   if (MIN_UNEXPAND <= BE (kws))
-    fro_spew (work->fro, work->ex);
+    fro_spew (work->fro, MANI (newwork));
   else
     {
-      struct expctx ctx = EXPCTX_1OUT (work->ex, work->fro, false, dolog);
+      struct expctx ctx = EXPCTX_1OUT (MANI (newwork), work->fro,
+                                       false, dolog);
 
       for (;;)
         {
@@ -609,9 +610,10 @@ ci_main (const char *cmd, int argc, char **argv)
   char targetdatebuf[datesize + zonelenmax];
   char *a, **newargv, *textfile;
   char const *author, *krev, *rev, *state;
-  char const *diffname, *expname;
+  char const *diffname, *expname = NULL;
+  struct fro *exp;
   char const *newworkname;
-  struct work work = { .ex = NULL };
+  struct work work = { .fro = NULL };
   bool forceciflag = false;
   bool keepworkingfile = false;
   bool rcsinitflag = false;
@@ -815,7 +817,10 @@ ci_main (const char *cmd, int argc, char **argv)
     cleanup (&exitstatus, &work);
   else if (argc < 1)
     PFATAL ("no input file");
-  else
+  /* Workers cannot read a log message or a description from stdin,
+     so use them only if these were given with ‘-m’ and ‘-t’.  */
+  else if (! (reason.upfront.size && textfile
+              && jobs_split (&argc, &argv, &exitstatus)))
     for (; 0 < argc; cleanup (&exitstatus, &work), ++argv, --argc)
       {
         /* Use var instead of simple #define for fast identity compare.  */
@@ -1013,13 +1018,24 @@ ci_main (const char *cmd, int argc, char **argv)
             newhead = tip == &bud.d;
             if (!newhead)
               FLOW (to) = frew;
-            expname = buildrevision (deltas, bud.target, NULL, false);
+            /* Only diff(1) needs the previous revision in a file;
+               otherwise, build it in memory if it is small.  */
+            if (BE (external_diff))
+              {
+                expname = buildrevision (deltas, bud.target, NULL, false);
+                if (!(exp = fro_open (expname, FOPEN_R_WORK, NULL)))
+                  fatal_sys (expname);
+              }
+            else
+              exp = buildrevision_fro (deltas, bud.target, false,
+                                       work.st.st_size);
             if (!forceciflag
                 && STR_SAME (bud.d.state, bud.target->state)
-                && ((changework = rcsfcmp (work.fro, &work.st, expname,
+                && ((changework = rcsfcmp (work.fro, &work.st, exp,
                                            bud.target))
                     <= 0))
               {
+                fro_zclose (&exp);
                 diagnose
                   ("file is unchanged; reverting to previous revision %s",
                    bud.target->num);
@@ -1083,32 +1099,48 @@ ci_main (const char *cmd, int argc, char **argv)
                 SAME_AFTER (from, bud.target->text);
                 bud.d.pretty_log = getlogmsg (&reason, &bud);
 
-                /* "Rewind" ‘work.fro’ before feeding it to diff(1).  */
-                fro_bob (work.fro);
-                if (PROB (lseek (wfd, 0, SEEK_SET)))
-                  Ierror ();
+                if (!BE (external_diff))
+                  {
+                    if (newhead)
+                      {
+                        fro_bob (work.fro);
+                        putdftext (&bud.d, work.fro, frew, false);
+                        putddtext (bud.target, work.fro, exp, frew);
+                      }
+                    else
+                      putddtext (&bud.d, exp, work.fro, frew);
+                    fro_zclose (&exp);
+                  }
+                else
+                  {
+                    fro_zclose (&exp);
+                    /* "Rewind" ‘work.fro’ before feeding it to diff(1).  */
+                    fro_bob (work.fro);
+                    if (PROB (lseek (wfd, 0, SEEK_SET)))
+                      Ierror ();
 
-                diffp = diffv;
-                *++diffp = prog_diff;
-                *++diffp = diff_flags;
+                    diffp = diffv;
+                    *++diffp = prog_diff;
+                    *++diffp = diff_flags;
 #if OPEN_O_BINARY
-                if (kws == kwsub_b)
-                  *++diffp = "--binary";
+                    if (kws == kwsub_b)
+                      *++diffp = "--binary";
 #endif
-                *++diffp = newhead ? "-" : expname;
-                *++diffp = newhead ? expname : "-";
-                *++diffp = NULL;
-                if (DIFF_TROUBLE == runv (wfd, diffname, diffv))
-                  RFATAL ("diff failed");
-                if (newhead)
-                  {
-                    fro_bob (work.fro);
-                    putdftext (&bud.d, work.fro, frew, false);
-                    if (!putdtext (bud.target, diffname, frew, true))
+                    *++diffp = newhead ? "-" : expname;
+                    *++diffp = newhead ? expname : "-";
+                    *++diffp = NULL;
+                    if (DIFF_TROUBLE == runv (wfd, diffname, diffv))
+                      RFATAL ("diff failed");
+                    if (newhead)
+                      {
+                        fro_bob (work.fro);
+                        putdftext (&bud.d, work.fro, frew, false);
+                        if (!putdtext (bud.target, diffname, frew, true))
+                          continue;
+                      }
+                    else if (!putdtext (&bud.d, diffname, frew, true))
                       continue;
                   }
-                else if (!putdtext (&bud.d, diffname, frew, true))
-                  continue;
 
                 /* Check whether the working file changed during checkin,
                    to avoid producing an inconsistent RCS file.  */
@@ -1176,9 +1208,9 @@ ci_main (const char *cmd, int argc, char **argv)
                     /* fall into */
                   case 1:
                     fro_zclose (&work.fro);
-                    aflush (work.ex);
+                    aflush (MANI (newwork));
                     IGNOREINTS ();
-                    r = chnamemod (&work.ex, newworkname, mani_filename,
+                    r = chnamemod (&MANI (newwork), newworkname, mani_filename,
                                    1, newworkmode, mtime);
                     keepdirtemp (newworkname);
                     RESTOREINTS ();
@@ -1195,6 +1227,7 @@ ci_main (const char *cmd, int argc, char **argv)
       }
 
   tempunlink ();
+  jobs_done (exitstatus);
   gnurcs_goodbye ();
   return exitstatus;
 }
@@ -34,6 +34,7 @@
 #include "b-feph.h"
 #include "b-fro.h"
 #include "b-isr.h"
+#include "b-jobs.h"
 #include "b-peer.h"
 
 struct work
@@ -63,7 +64,7 @@ struct jstuff
 };
 
 static void
-cleanup (int *exitstatus, FILE **neworkptr)
+cleanup (int *exitstatus)
 {
   FILE *mstdout = MANI (standard_output);
 
@@ -76,8 +77,8 @@ cleanup (int *exitstatus, FILE **neworkptr)
       && FLOW (res)
       && FLOW (res) != mstdout)
     Ozclose (&FLOW (res));
-  if (*neworkptr != mstdout)
-    Ozclose (neworkptr);
+  if (MANI (newwork) != mstdout)
+    Ozclose (&MANI (newwork));
   dirtempunlink ();
 }
 
@@ -317,29 +318,31 @@ buildjoin (char const *initialfile, struct jstuff *js)
   char const **p;
   size_t len;
   char const *subs = NULL;
+  /* Build the revisions to merge in-process, unless the RCS file
+     has been closed because of a lock (see ‘co_main’).  */
+  bool inproc = FLOW (from) && !FLOW (to);
 
   rev2 = maketemp (0);
   rev3 = maketemp (3);      /* ‘buildrevision’ may use 1 and 2 */
 
-  cov[1] = PEER_SUPER ();
-  cov[2] = "co";
-  /* ‘cov[VX]’ setup below.  */
-  p = &cov[1 + VX];
-  if (js->expand)
-    *p++ = js->expand;
-  if (js->suffix)
-    *p++ = js->suffix;
-  if (js->version)
-    *p++ = js->version;
-  if (js->zone)
-    *p++ = js->zone;
-  *p++ = quietarg;
-  *p++ = REPO (filename);
-  *p = '\0';
-
-  mergev[1] = find_peer_prog (js->merge);
-  mergev[2] = mergev[4] = "-L";
-  /* Rest of ‘mergev’ setup below.  */
+  if (!inproc)
+    {
+      cov[1] = PEER_SUPER ();
+      cov[2] = "co";
+      /* ‘cov[VX]’ setup below.  */
+      p = &cov[1 + VX];
+      if (js->expand)
+        *p++ = js->expand;
+      if (js->suffix)
+        *p++ = js->suffix;
+      if (js->version)
+        *p++ = js->version;
+      if (js->zone)
+        *p++ = js->zone;
+      *p++ = quietarg;
+      *p++ = REPO (filename);
+      *p = '\0';
+    }
 
   i = 0;
   while (i < js->lastidx)
@@ -353,30 +356,78 @@ buildjoin (char const *initialfile, struct jstuff *js)
           ACCF ("%s,%s:%s", subs, js->ls[i - 2], js->ls[i - 1]);
           subs = finish_string (SINGLE, &len);
         }
-      diagnose ("revision %s", js->ls[i]);
-      ACCF ("-p%s", js->ls[i]);
-      cov[VX] = finish_string (SINGLE, &len);
-      if (runv (-1, rev2, cov))
-        goto badmerge;
-      diagnose ("revision %s", js->ls[i + 1]);
-      ACCF ("-p%s", js->ls[i + 1]);
-      cov[VX] = finish_string (SINGLE, &len);
-      if (runv (-1, rev3, cov))
-        goto badmerge;
+      if (inproc)
+        {
+          struct delta *t[2];
+          FILE *out[2];
+
+          /* Build both revisions as "co -q -pREV" would,
+             in one pass over the delta chains.  */
+          BE (inclusive_of_Locker_in_Id_val) = false;
+          for (int k = 0; k < 2; k++)
+            {
+              diagnose ("revision %s", js->ls[i + k]);
+              if (!(t[k] = delta_from_ref (js->ls[i + k])))
+                goto badmerge;
+              t[k]->name = NULL;
+              if (!(out[k] = fopen_safer (k ? rev3 : rev2, FOPEN_W_WORK)))
+                fatal_sys (k ? rev3 : rev2);
+            }
+          buildrevisions (2, t, out, BE (kws) < MIN_UNEXPAND);
+          Ozclose (&out[0]);
+          Ozclose (&out[1]);
+        }
+      else
+        {
+          struct child kid[2];
+          int bad;
+
+          /* The two "co -pREV" are independent; run them at once.  */
+          for (int k = 0; k < 2; k++)
+            {
+              diagnose ("revision %s", js->ls[i + k]);
+              ACCF ("-p%s", js->ls[i + k]);
+              cov[VX] = finish_string (SINGLE, &len);
+              spawn (&kid[k], -1, k ? rev3 : rev2, cov);
+            }
+          bad = reap_child (&kid[0]);
+          bad |= reap_child (&kid[1]);
+          if (bad)
+            goto badmerge;
+        }
       diagnose ("merging...");
-      mergev[3] = subs;
-      mergev[5] = js->ls[i + 1];
-      p = &mergev[6];
-      if (BE (quiet))
-        *p++ = quietarg;
-      if (js->lastidx <= i + 2 && MANI (standard_output))
-        *p++ = "-p";
-      *p++ = initialfile;
-      *p++ = rev2;
-      *p++ = rev3;
-      *p = '\0';
-      if (DIFF_TROUBLE == runv (-1, NULL, mergev))
-          goto badmerge;
+      if (BE (external_diff))
+        {
+          /* Run merge(1), whose diff3(1) temporary files
+             would otherwise collide with ours.  */
+          mergev[1] = find_peer_prog (js->merge);
+          mergev[2] = mergev[4] = "-L";
+          mergev[3] = subs;
+          mergev[5] = js->ls[i + 1];
+          p = &mergev[6];
+          if (BE (quiet))
+            *p++ = quietarg;
+          if (js->lastidx <= i + 2 && MANI (standard_output))
+            *p++ = "-p";
+          *p++ = initialfile;
+          *p++ = rev2;
+          *p++ = rev3;
+          *p = '\0';
+          if (DIFF_TROUBLE == runv (-1, NULL, mergev))
+            goto badmerge;
+        }
+      else
+        {
+          struct symdef three_manifestations[3] =
+            {
+              { .meaningful = subs, .underlying = initialfile },
+              { .meaningful = js->ls[i + 1], .underlying = rev2 },
+              { .meaningful = rev3, .underlying = rev3 }
+            };
+
+          merge (js->lastidx <= i + 2 && MANI (standard_output),
+                 NULL, three_manifestations);
+        }
       i = i + 2;
 #undef ACCF
     }
@@ -393,7 +444,6 @@ co_main (const char *cmd, int argc, char **argv)
   int exitstatus = EXIT_SUCCESS;
   struct work work = { .force = false };
   struct jstuff jstuff;
-  FILE *neworkptr = NULL;
   int lockflag = 0;                 /* -1: unlock, 0: do nothing, 1: lock.  */
   bool mtimeflag = false;
   char *a, *joinflag, **newargv;
@@ -559,11 +609,11 @@ co_main (const char *cmd, int argc, char **argv)
 
   /* Now handle all filenames.  */
   if (FLOW (erroneousp))
-    cleanup (&exitstatus, &neworkptr);
+    cleanup (&exitstatus);
   else if (argc < 1)
     PFATAL ("no input file");
-  else
-    for (; 0 < argc; cleanup (&exitstatus, &neworkptr), ++argv, --argc)
+  else if (! jobs_split (&argc, &argv, &exitstatus))
+    for (; 0 < argc; cleanup (&exitstatus), ++argv, --argc)
       {
         struct stat *repo_stat;
         char const *mani_filename;
@@ -598,7 +648,7 @@ co_main (const char *cmd, int argc, char **argv)
               }
 #endif
             neworkname = NULL;
-            neworkptr = MANI (standard_output) = stdout;
+            MANI (newwork) = MANI (standard_output) = stdout;
           }
         else
           {
@@ -610,7 +660,7 @@ co_main (const char *cmd, int argc, char **argv)
                 continue;
               }
             neworkname = makedirtemp (true);
-            if (!(neworkptr = fopen_safer (neworkname, FOPEN_W_WORK)))
+            if (!(MANI (newwork) = fopen_safer (neworkname, FOPEN_W_WORK)))
               {
                 if (errno == EACCES)
                   MERR ("permission denied on parent directory");
@@ -639,6 +689,7 @@ co_main (const char *cmd, int argc, char **argv)
             struct cbuf numericrev;
             int locks = lockflag ? findlock (false, &jstuff.d) : 0;
             struct fro *from = FLOW (from);
+            bool keepfrom;
 
             if (rev)
               {
@@ -701,16 +752,33 @@ co_main (const char *cmd, int argc, char **argv)
             BE (inclusive_of_Locker_in_Id_val) = 0 < lockflag;
             jstuff.d->name = namedrev (rev, jstuff.d);
             joinname = buildrevision (deltas, jstuff.d,
-                                      joinflag && tostdout ? NULL : neworkptr,
+                                      (joinflag && tostdout
+                                       ? NULL
+                                       : MANI (newwork)),
                                       kws < MIN_UNEXPAND);
-            if (FLOW (res) == neworkptr)
+            if (FLOW (res) == MANI (newwork))
               FLOW (res) = NULL;             /* Don't close it twice.  */
             if (changelock && deltas->entry != jstuff.d)
               fro_trundling (true, from);
 
-            if (PROB (donerewrite (changelock, Ttimeflag
-                                   ? repo_stat->st_mtime
-                                   : (time_t) - 1)))
+            /* For a join, keep the old RCS file open (if the host
+               allows renaming over an open file), so that ‘buildjoin’
+               can build the revisions to merge from it directly.  */
+            keepfrom = !WOE && joinflag && changelock && !FLOW (erroneousp);
+            if (keepfrom)
+              {
+                fro_spew (from, FLOW (rewr));
+                FLOW (from) = NULL;
+              }
+            r = donerewrite (changelock, Ttimeflag
+                             ? repo_stat->st_mtime
+                             : (time_t) - 1);
+            if (keepfrom)
+              {
+                FLOW (from) = from;
+                FLOW (to) = NULL;
+              }
+            if (PROB (r))
               continue;
 
             if (changelock)
@@ -726,7 +794,7 @@ co_main (const char *cmd, int argc, char **argv)
                 newdate = NULL;
                 if (!joinname)
                   {
-                    aflush (neworkptr);
+                    aflush (MANI (newwork));
                     joinname = neworkname;
                   }
                 if (kws == kwsub_b)
@@ -742,9 +810,10 @@ co_main (const char *cmd, int argc, char **argv)
                                    || (lockflag <= 0 && BE (strictly_locking))));
             time_t t = mtimeflag
               && newdate ? date2time (newdate) : (time_t) - 1;
-            aflush (neworkptr);
+            aflush (MANI (newwork));
             IGNOREINTS ();
-            r = chnamemod (&neworkptr, neworkname, mani_filename, 1, m, t);
+            r = chnamemod (&MANI (newwork), neworkname, mani_filename,
+                           1, m, t);
             keepdirtemp (neworkname);
             RESTOREINTS ();
             if (PROB (r))
@@ -758,7 +827,10 @@ co_main (const char *cmd, int argc, char **argv)
       }
 
   tempunlink ();
-  Ozclose (&MANI (standard_output));
+  /* Don't close stdout; a nesting caller (e.g., "grcs batch")
+     might still need it.  */
+  oflush ();
+  jobs_done (exitstatus);
   gnurcs_goodbye ();
   return exitstatus;
 }
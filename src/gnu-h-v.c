@@ -54,13 +54,13 @@ check_hv (int argc, char **argv, struct program const *prog)
   if (EXACTLY ("--help", argv[1]))
     {
       printf ("Usage: %s %s%s", prog->name, prog->help, BUGME);
-      exit (EXIT_SUCCESS);
+      gnurcs_exit (EXIT_SUCCESS);
     }
 
   if (EXACTLY ("--version", argv[1]))
     {
       display_version (prog);
-      exit (EXIT_SUCCESS);
+      gnurcs_exit (EXIT_SUCCESS);
     }
 }
 
@@ -26,7 +26,7 @@
 #include "ident.help"
 #include "b-complain.h"
 
-struct top *top;
+THREAD_LOCAL struct top *top;
 
 static int
 match (register FILE *fp)
@@ -26,7 +26,7 @@
 #include "b-feph.h"
 #include "b-merger.h"
 
-struct top *top;
+THREAD_LOCAL struct top *top;
 
 int
 main (int argc, char **argv)
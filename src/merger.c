@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "b-complain.h"
+#include "b-diff.h"
 #include "b-divvy.h"
 #include "b-fb.h"
 #include "b-feph.h"
@@ -42,13 +43,171 @@ normalize_arg (char const *s)
     return s;
 }
 
+struct hunk
+{
+  size_t lo, hi;
+  /* Range of changed lines in the common ancestor.  */
+
+  size_t olo, ohi;
+  /* Range of the lines replacing them in the other text.  */
+};
+
+static struct hunk *
+hunks (struct divvy *space, struct difflines const *b,
+       struct difflines const *o)
+/* Return the runs of changes, as computed by ‘diff_lines’, that turn
+   ‘b’ into ‘o’, terminated by a hunk whose ‘lo’ is past the end.  */
+{
+  struct hunk *rv = alloc (space, "hunks",
+                           (b->count + 2) * sizeof (struct hunk));
+  struct hunk *h = rv;
+  size_t i, j;
+
+  for (i = j = 0; i < b->count || j < o->count;)
+    {
+      size_t i0 = i, j0 = j;
+
+      while (i < b->count && b->changed[i])
+        i++;
+      while (j < o->count && o->changed[j])
+        j++;
+      if (i0 < i || j0 < j)
+        *h++ = (struct hunk){ .lo = i0, .hi = i, .olo = j0, .ohi = j };
+      else
+        i++, j++;
+    }
+  h->lo = h->hi = b->count + 1;
+  return rv;
+}
+
+static void
+put_lines (struct divvy *out, struct difflines const *t,
+           size_t lo, size_t hi, bool marked)
+/* Append lines ‘lo’ up to ‘hi’ of ‘t’ to ‘out’.  If ‘marked’,
+   a conflict marker follows, so make sure they end in a newline.  */
+{
+  accumulate_range (out, t->beg[lo], t->beg[hi]);
+  if (marked && lo < hi && '\n' != t->beg[hi][-1])
+    accumulate_byte (out, '\n');
+}
+
 int
-merge (bool tostdout, char const *edarg, struct symdef three_manifestations[3])
-/* Do ‘merge [-p] EDARG -L l0 -L l1 -L l2 a0 a1 a2’, where ‘tostdout’
-   specifies whether ‘-p’ is present, ‘edarg’ gives the editing type
-   (e.g. "-A", or null for the default), and lN and aN are taken from
-   three_manifestations[N].{meaningful,underlying}, respectively.
-   Return ‘DIFF_SUCCESS’ or ‘DIFF_FAILURE’.  */
+merge_texts (struct divvy *space, struct cbuf *result, char const *edarg,
+             char const *label[3], struct cbuf const text[3])
+/* Merge the changes from ‘text[1]’ to ‘text[2]’ into ‘text[0]’,
+   like ‘diff3 -m EDARG’, where ‘edarg’ is "-A", "-E" or "-e", and
+   conflicts are bracketed with the respective ‘label’s.  Set
+   ‘*result’ to the merged text, allocated in ‘space’.
+   Return ‘DIFF_FAILURE’ if there were conflicts, else ‘DIFF_SUCCESS’.  */
+{
+  struct divvy *scratch = make_space ("merge");
+  bool show_all = 'A' == edarg[1], flagging = 'e' != edarg[1];
+  struct difflines b[2], t[2];
+  struct hunk *h[2];
+  /* Per side, the next hunk, and where the last one ended
+     in the common ancestor and in that side, respectively.  */
+  size_t k[2] = { 0, 0 }, bend[2] = { 0, 0 }, oend[2] = { 0, 0 };
+  size_t mpos = 0;
+  int rv = DIFF_SUCCESS;
+
+#define MARK(c,n)  accf (space, "%s %s\n", c c c c c c c, label[n])
+
+  for (int s = 0; s < 2; s++)
+    {
+      diff_lines (scratch, text[1], text[2 * s], &b[s], &t[s]);
+      h[s] = hunks (scratch, &b[s], &t[s]);
+    }
+
+  /* Collect hunks that overlap or touch, from either side, into
+     groups.  A group changed on only one side takes that side's
+     lines; otherwise, it is a conflict, unless both sides made
+     the same change.  Between groups, take the lines of ‘text[0]’.  */
+  while (h[0][k[0]].lo <= b[0].count
+         || h[1][k[1]].lo <= b[0].count)
+    {
+      size_t first[2] = { k[0], k[1] }, lo[2], hi[2], glo, ghi;
+      bool more = true;
+
+      glo = ghi = h[0][k[0]].lo <= h[1][k[1]].lo
+        ? h[0][k[0]].lo
+        : h[1][k[1]].lo;
+      while (more)
+        {
+          more = false;
+          for (int s = 0; s < 2; s++)
+            for (; h[s][k[s]].lo <= ghi; k[s]++)
+              {
+                if (ghi < h[s][k[s]].hi)
+                  ghi = h[s][k[s]].hi;
+                more = true;
+              }
+        }
+
+      /* Find the lines of each side that correspond to the group.  */
+      for (int s = 0; s < 2; s++)
+        if (first[s] < k[s])
+          {
+            struct hunk *f = &h[s][first[s]], *l = &h[s][k[s] - 1];
+
+            lo[s] = f->olo - (f->lo - glo);
+            hi[s] = l->ohi + (ghi - l->hi);
+            bend[s] = l->hi;
+            oend[s] = l->ohi;
+          }
+        else
+          {
+            lo[s] = glo - bend[s] + oend[s];
+            hi[s] = ghi - bend[s] + oend[s];
+          }
+
+      if (first[1] == k[1])
+        /* Changed only in ‘text[0]’; keep it.  */
+        continue;
+
+      put_lines (space, &t[0], mpos, lo[0], false);
+      mpos = hi[0];
+      if (first[0] < k[0])
+        {
+          size_t len = t[0].beg[hi[0]] - t[0].beg[lo[0]];
+          bool same = (len == (size_t) (t[1].beg[hi[1]] - t[1].beg[lo[1]])
+                       && MEM_SAME (len, t[0].beg[lo[0]], t[1].beg[lo[1]]));
+
+          if (same ? show_all : flagging)
+            {
+              rv = DIFF_FAILURE;
+              if (same)
+                MARK ("<", 1);
+              else
+                {
+                  MARK ("<", 0);
+                  put_lines (space, &t[0], lo[0], hi[0], true);
+                  if (show_all)
+                    MARK ("|", 1);
+                }
+              if (show_all)
+                put_lines (space, &b[0], glo, ghi, true);
+              accs (space, "=======\n");
+              put_lines (space, &t[1], lo[1], hi[1], true);
+              MARK (">", 2);
+              continue;
+            }
+        }
+      put_lines (space, &t[1], lo[1], hi[1], false);
+    }
+  put_lines (space, &t[0], mpos, t[0].count, false);
+
+#undef MARK
+
+  result->string = finish_string (space, &result->size);
+  close_space (scratch);
+  return rv;
+}
+
+static int
+merge_external (bool tostdout, char const *edarg,
+                struct symdef three_manifestations[3])
+/* Like ‘merge’, but run diff3(1) (and, without ‘DIFF3_BIN’,
+   diff(1) and ed(1)) to do the work.  */
 {
   register int i;
   FILE *f;
@@ -62,9 +221,6 @@ merge (bool tostdout, char const *edarg, struct symdef three_manifestations[3])
   for (i = 3; 0 <= --i;)
     a[i] = normalize_arg (FNAME (i));
 
-  if (!edarg)
-    edarg = "-E";
-
 #if DIFF3_BIN
   t = NULL;
   if (!tostdout)
@@ -87,10 +243,23 @@ merge (bool tostdout, char const *edarg, struct symdef three_manifestations[3])
       Ozclose (&f);
     }
 #else  /* !DIFF3_BIN */
-  for (i = 0; i < 2; i++)
-    if (DIFF_TROUBLE == run (-1, d[i] = maketemp (i), prog_diff,
-                             a[i], a[2], NULL))
-      PFATAL ("diff failed");
+  {
+    struct child kid[2];
+    char const *diffv[5];
+
+    /* The two diffs are independent; run them at once.  */
+    diffv[1] = prog_diff;
+    diffv[3] = a[2];
+    diffv[4] = NULL;
+    for (i = 0; i < 2; i++)
+      {
+        diffv[2] = a[i];
+        spawn (&kid[i], -1, d[i] = maketemp (i), diffv);
+      }
+    for (i = 0; i < 2; i++)
+      if (DIFF_TROUBLE == reap_child (&kid[i]))
+        PFATAL ("diff failed");
+  }
   t = maketemp (2);
   s = run (-1, t,
            prog_diff3, edarg, d[0], d[1], a[0], a[1], a[2],
@@ -114,4 +283,51 @@ merge (bool tostdout, char const *edarg, struct symdef three_manifestations[3])
   return s;
 }
 
+int
+merge (bool tostdout, char const *edarg, struct symdef three_manifestations[3])
+/* Do ‘merge [-p] EDARG -L l0 -L l1 -L l2 a0 a1 a2’, where ‘tostdout’
+   specifies whether ‘-p’ is present, ‘edarg’ gives the editing type
+   (e.g. "-A", or null for the default), and lN and aN are taken from
+   three_manifestations[N].{meaningful,underlying}, respectively.
+   Return ‘DIFF_SUCCESS’ or ‘DIFF_FAILURE’.  */
+{
+  struct divvy *space;
+  struct fro *from[3];
+  struct cbuf text[3], result;
+  char const *label[3];
+  FILE *f;
+  int s;
+
+  if (!edarg)
+    edarg = "-E";
+  if (BE (external_diff))
+    return merge_external (tostdout, edarg, three_manifestations);
+
+  space = make_space ("merge");
+  for (int i = 0; i < 3; i++)
+    {
+      if (!(from[i] = fro_open (FNAME (i), FOPEN_R_WORK, NULL)))
+        fatal_sys (FNAME (i));
+      text[i] = fro_contents (space, from[i]);
+      label[i] = LABEL (i);
+    }
+  s = merge_texts (space, &result, edarg, label, text);
+  for (int i = 0; i < 3; i++)
+    fro_close (from[i]);
+  if (DIFF_FAILURE == s)
+    PWARN ("conflicts during merge");
+
+  if (tostdout)
+    awrite (result.string, result.size, stdout);
+  else
+    {
+      if (!(f = fopen_safer (FNAME (0), FOPEN_W_WORK)))
+        fatal_sys (FNAME (0));
+      awrite (result.string, result.size, f);
+      Ozclose (&f);
+    }
+  close_space (space);
+  return s;
+}
+
 /* merger.c ends here */
@@ -31,6 +31,7 @@
 #include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
+#include "b-grok.h"
 
 struct u_log
 {
@@ -373,7 +374,7 @@ scanlogtext (struct adminstuff *dc,
   /* Got the one we're looking for.  */
   fro_move (from, range.end);
   if (edit)
-    editstring (es, text, NULL);
+    editstring (es, text);
   else
     enterstring (es, text);
 }
@@ -545,10 +546,13 @@ searchcutpt (struct adminstuff *dc,
    is the entry point to the one with number being ‘object’.  */
 {
   struct delta *delta;
+  struct revtuple const *rt = make_revtuple (SINGLE, object);
 
   dc->cuthead = NULL;
   while (delta = store->entry,
-         compartial (delta->num, object, length))
+         rt && delta->tuple
+         ? cmptuple (delta->tuple, rt, length)
+         : compartial (delta->num, object, length))
     {
       dc->cuthead = delta;
       store = store->next;
@@ -705,7 +709,7 @@ removerevs (struct adminstuff *dc)
 
   if (length > 2)
     {                           /* delete revisions on branches */
-      if (NUM_GT (target->num, target2->num))
+      if (0 < cmpdelta (target, target2))
         {
           cmp = cmpnum (target2->num, numrev.string);
           temp = target;
@@ -714,7 +718,7 @@ removerevs (struct adminstuff *dc)
         }
       if (cmp)
         {
-          if (NUM_EQ (target->num, target2->num))
+          if (0 == cmpdelta (target, target2))
             {
               RERR ("Revisions %s-%s don't exist.",
                     dc->delrev.strt, dc->delrev.end);
@@ -729,7 +733,7 @@ removerevs (struct adminstuff *dc)
     }
   else
     {                           /* delete revisions on trunk */
-      if (NUM_LT (target->num, target2->num))
+      if (0 > cmpdelta (target, target2))
         {
           temp = target;
           target = target2;
@@ -739,7 +743,7 @@ removerevs (struct adminstuff *dc)
         cmp = cmpnum (target2->num, numrev.string);
       if (cmp)
         {
-          if (NUM_EQ (target->num, target2->num))
+          if (0 == cmpdelta (target, target2))
             {
               RERR ("Revisions %s-%s don't exist.",
                     dc->delrev.strt, dc->delrev.end);
@@ -781,21 +785,9 @@ doassoc (struct adminstuff *dc)
       if (!under)
         /* Delete symbol.  */
         {
-          struct link box, *tp;
-          struct symdef const *d = NULL;
-
-          for (box.next = GROK (symbols), tp = &box; tp->next; tp = tp->next)
-            {
-              d = tp->next->entry;
-              if (STR_SAME (ssymbol, d->meaningful))
-                {
-                  tp->next = tp->next->next;
-                  changed = true;
-                  break;
-                }
-            }
-          GROK (symbols) = box.next;
-          if (!d)
+          if (grok_symbol_unset (REPO (r), ssymbol))
+            changed = true;
+          else
             RWARN ("can't delete nonexisting symbol %s", ssymbol);
         }
       else
@@ -990,6 +982,7 @@ buildeltatext (struct adminstuff *dc,
    change to delta text.  */
 {
   FILE *fcut;                       /* temporary file to rebuild delta tree */
+  char const *cutname = NULL;
   FILE *frew = FLOW (rewr);
 
   fcut = NULL;
@@ -997,8 +990,8 @@ buildeltatext (struct adminstuff *dc,
   scanlogtext (dc, es, ls, deltas->entry, false);
   if (dc->cuthead)
     {
-      if (! (fcut = tmpfile ()))
-        fatal_sys ("tmpfile");
+      if (! (fcut = fopen_safer (cutname = maketemp (1), FOPEN_W_WORK)))
+        fatal_sys (cutname);
 
       while (deltas->entry != dc->cuthead)
         {
@@ -1008,8 +1001,7 @@ buildeltatext (struct adminstuff *dc,
         }
 
       snapshotedit (es, fcut);
-      rewind (fcut);
-      aflush (fcut);
+      Ozclose (&fcut);
     }
 
   while (deltas->entry != dc->cuttail)
@@ -1021,7 +1013,20 @@ buildeltatext (struct adminstuff *dc,
   finishedit (es, NULL, NULL, true);
   Ozclose (&FLOW (res));
 
-  if (fcut)
+  if (cutname && !BE (external_diff))
+    {
+      struct fro *cut, *res;
+
+      if (!(cut = fro_open (cutname, FOPEN_R_WORK, NULL)))
+        fatal_sys (cutname);
+      if (!(res = fro_open (FLOW (result), FOPEN_R_WORK, NULL)))
+        fatal_sys (FLOW (result));
+      putddtext (dc->cuttail, cut, res, frew);
+      fro_close (res);
+      fro_close (cut);
+      return true;
+    }
+  else if (cutname)
     {
       char const *diffname = maketemp (0);
       char const *diffv[6 + !!OPEN_O_BINARY];
@@ -1033,12 +1038,11 @@ buildeltatext (struct adminstuff *dc,
       if (BE (kws) == kwsub_b)
         *++diffp == "--binary";
 #endif
-      *++diffp = "-";
+      *++diffp = cutname;
       *++diffp = FLOW (result);
       *++diffp = '\0';
-      if (DIFF_TROUBLE == runv (fileno (fcut), diffname, diffv))
+      if (DIFF_TROUBLE == runv (-1, diffname, diffv))
         RFATAL ("diff failed");
-      Ozclose (&fcut);
       return putdtext (dc->cuttail, diffname, frew, true);
     }
   else
@@ -1092,6 +1096,8 @@ buildtree (struct adminstuff *dc)
         }
       REPO (tip) = dc->cuttail;
     }
+  for (Delta = dc->delstrt; Delta != dc->cuttail; Delta = Delta->ilk)
+    grok_forget (REPO (r), Delta);
   return;
 }
 
@@ -33,6 +33,7 @@
 #include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
+#include "b-jobs.h"
 
 static void
 cleanup (int *exitstatus, struct fro **workptr)
@@ -108,6 +109,7 @@ rcsclean_main (const char *cmd, int argc, char **argv)
   char *a, **newargv;
   char const *rev, *p;
   bool dounlock, perform, unlocked, unlockflag, waslocked, Ttimeflag;
+  bool different;
   int expmode;
   struct wlink *deltas;
   struct delta *delta;
@@ -203,7 +205,7 @@ rcsclean_main (const char *cmd, int argc, char **argv)
 
   if (FLOW (erroneousp))
     cleanup (&exitstatus, &workptr);
-  else
+  else if (! jobs_split (&argc, &argv, &exitstatus))
     for (; 0 < argc; cleanup (&exitstatus, &workptr), ++argv, --argc)
       {
         struct stat *repo_stat;
@@ -273,11 +275,17 @@ rcsclean_main (const char *cmd, int argc, char **argv)
 
         write_desc_maybe (FLOW (to));
 
-        if (!delta
-            ? workstat.st_size != 0
-            : 0 < rcsfcmp (workptr, &workstat,
-                           buildrevision (deltas, delta, NULL, false),
-                           delta))
+        if (!delta)
+          different = workstat.st_size != 0;
+        else
+          {
+            struct fro *exp = buildrevision_fro (deltas, delta, false,
+                                                 workstat.st_size);
+
+            different = 0 < rcsfcmp (workptr, &workstat, exp, delta);
+            fro_close (exp);
+          }
+        if (different)
           continue;
 
         if (BE (quiet) < unlocked)
@@ -305,7 +313,8 @@ rcsclean_main (const char *cmd, int argc, char **argv)
 
   tempunlink ();
   if (!BE (quiet))
-    fclose (stdout);
+    fflush (stdout);
+  jobs_done (exitstatus);
   gnurcs_goodbye ();
   return exitstatus;
 }
@@ -23,12 +23,15 @@
 #include "base.h"
 #include <string.h>
 #include <errno.h>
+#include <stdlib.h>
 #include "rcsdiff.help"
 #include "b-complain.h"
+#include "b-diff.h"
 #include "b-divvy.h"
+#include "b-esds.h"
+#include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
-#include "b-peer.h"
 
 /* Normally, if the two revisions specified are the same, we avoid calling
    the underlying diff on the theory that it will produce no output.  This
@@ -107,9 +110,190 @@ setup_label (char const *num, char const date[datesize])
 }
 #endif
 
-/* Elements in the constructed command line prior to this index are
-   boilerplate.  From this index on, things are data-dependent.  */
-#define COMMAND_LINE_VARYING  (4 + !DIFF_L)
+static bool
+fast_format (char const **beg, char const **end, long *context)
+/* Return true if the diff(1) options [beg,end) ask for nothing but the
+   default or unified output format, setting ‘*context’ to -1 for the
+   former, or to the number of lines of context for the latter.  */
+{
+  *context = -1;
+  for (; beg < end; beg++)
+    {
+      char const *a = *beg, *num;
+
+      if (STR_SAME (a, "-u") || STR_SAME (a, "--unified"))
+        num = "3";
+      else if (! strncmp (a, "--unified=", 10))
+        num = a + 10;
+      else if (! strncmp (a, "-U", 2))
+        num = a[2]
+          ? a + 2
+          : (beg + 1 < end ? *++beg : "");
+      else
+        return false;
+      if (!*num || num[strspn (num, "0123456789")])
+        return false;
+      *context = atol (num);
+    }
+  /* Without ‘--label’, diff(1) would name the temporary files.  */
+  return DIFF_L || 0 > *context;
+}
+
+static bool
+stored_against (struct delta const *d, struct delta const *base)
+/* Return true if the delta text of ‘d’ is an edit script
+   to be applied to the text of ‘base’.  */
+{
+  if (base->ilk == d)
+    return true;
+  for (struct wlink *ls = base->branches; ls; ls = ls->next)
+    if (ls->entry == d)
+      return true;
+  return false;
+}
+
+static bool
+script_line (struct fro *f, struct divvy *space, size_t *len)
+/* Read a line of an edit script from ‘f’ (unstuffing ‘SDELIM’),
+   appending it to the string being accumulated in ‘space’ and
+   adding its length to ‘*len’.  Return false if the script ends
+   before the end of the line.  */
+{
+  int c;
+
+  do
+    {
+      GETCHAR (c, f);
+      if (SDELIM == c)
+        {
+          GETCHAR (c, f);
+          if (SDELIM != c)
+            return false;
+        }
+      accumulate_byte (space, c);
+      ++*len;
+    }
+  while ('\n' != c);
+  return true;
+}
+
+static void
+script_lines (struct divvy *space, struct delta const *d,
+              struct difflines *bl, struct difflines *sl)
+/* Apply the edit script that is the delta text of ‘d’ to the lines
+   of ‘bl’, setting up ‘sl’ for the result.  Mark as changed the lines
+   that the script deletes from ‘bl’ and those that it adds to ‘sl’.  */
+{
+  struct fro *f = FLOW (from);
+  struct atat const *script = d->text;
+  /* Each added line is a line of the script.  */
+  size_t most = bl->count + atat_line_count (script);
+  size_t *off = alloc (space, "off", (most + 1) * sizeof (size_t));
+  bool *changed = zlloc (space, "changed", (most + 2) * sizeof (bool));
+  size_t i = 0, n = 0, len = 0;
+  bool more = true;
+  struct diffcmd dc;
+  char const *text;
+  int ed, c;
+
+  fro_move (f, script->beg);
+  GETCHAR (c, f);
+  initdiffcmd (&dc);
+  while (more && 0 <= (ed = getdiffcmd (f, true, NULL, &dc)))
+    {
+      size_t upto = ed ? dc.line1 : dc.line1 - 1;
+
+      if (bl->count < (ed ? upto : upto + dc.nlines))
+        fatal_syntax (atat_lno (script),
+                      "edit script refers to line past end of file");
+      for (; i < upto; i++)
+        {
+          off[n++] = len;
+          len += bl->beg[i + 1] - bl->beg[i];
+          accumulate_range (space, bl->beg[i], bl->beg[i + 1]);
+        }
+      if (!ed)
+        for (long k = dc.nlines; k--; i++)
+          bl->changed[i] = true;
+      else
+        for (long k = dc.nlines; more && k--; n++)
+          {
+            off[n] = len;
+            changed[1 + n] = true;
+            if (! (more = script_line (f, space, &len))
+                && (k || off[n] == len))
+              fatal_syntax (atat_lno (script),
+                            "edit script ends prematurely");
+          }
+    }
+  for (; i < bl->count; i++)
+    {
+      off[n++] = len;
+      len += bl->beg[i + 1] - bl->beg[i];
+      accumulate_range (space, bl->beg[i], bl->beg[i + 1]);
+    }
+  off[n] = len;
+  text = finish_string (space, &len);
+  sl->count = n;
+  sl->beg = alloc (space, "beg", (n + 1) * sizeof (char const *));
+  for (i = 0; i <= n; i++)
+    sl->beg[i] = text + off[i];
+  sl->changed = 1 + changed;
+}
+
+static bool
+plain_text_p (struct difflines const *dl, bool expandflag)
+/* Return true if the text of ‘dl’ has no NUL (which would make diff(1)
+   treat it as binary) and, if ‘expandflag’, no ‘KDELIM’ (which might
+   start a keyword that expands differently for each revision).  */
+{
+  char const *beg = dl->beg[0];
+  size_t len = dl->beg[dl->count] - beg;
+
+  return !memchr (beg, '\0', len)
+    && !(expandflag && memchr (beg, KDELIM, len));
+}
+
+static bool
+stored_diff (struct divvy *space, struct delta *t[2], bool expandflag,
+             struct fro *built[2], struct difflines *ol, struct difflines *nl)
+/* If one of ‘t[0]’ and ‘t[1]’ is stored as an edit script against
+   the other, use that script to set up ‘ol’ and ‘nl’ (allocated in
+   ‘space’) for the texts of ‘t[0]’ and ‘t[1]’, respectively, with the
+   differing lines marked, and return true.  If they are not adjacent
+   that way, or the script alone is not enough (see ‘plain_text_p’),
+   return false.  In either case, if the text of the base revision
+   ‘t[i]’ was built, leave it open in ‘built[i]’, which the caller must
+   close; if false is returned, it is also the expanded text.  */
+{
+  struct delta *base, *d;
+  struct difflines *bl, *sl;
+  struct wlink *chain;
+  struct fro **f;
+
+  if (stored_against (t[1], t[0]))
+    base = t[0], d = t[1], bl = ol, sl = nl, f = &built[0];
+  else if (stored_against (t[0], t[1]))
+    base = t[1], d = t[0], bl = nl, sl = ol, f = &built[1];
+  else
+    return false;
+
+  /* If keywords might be involved, don't bother building anything.
+     The lines the script adds are in its text; the base revision is
+     built from the texts of the deltas of its chain.  */
+  gr_revno (base->num, &chain);
+  if (expandflag
+      && (atat_has_kdelim (d->text) || chain_has_kdelim (chain)))
+    return false;
+
+  /* Build the base revision unexpanded, then apply the script to it.  */
+  *f = buildrevision_fro (chain, base, false, REPO (stat).st_size);
+  diff_split (space, fro_contents (space, *f), bl);
+  if (! plain_text_p (bl, expandflag))
+    return false;
+  script_lines (space, d, bl, sl);
+  return plain_text_p (sl, expandflag);
+}
 
 int
 rcsdiff_main (const char *cmd, int argc, char **argv)
@@ -119,19 +303,20 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
   int revnums;                  /* counter for revision numbers given */
   char const *rev1, *rev2;      /* revision numbers from command line */
   char const *xrev1, *xrev2;    /* expanded revision numbers */
-  char const *expandarg, *lexpandarg, *suffixarg, *versionarg, *zonearg;
+  char const *expandarg, *lexpandarg;
 #if DIFF_L
   int file_labels;
   char const **diff_label1, **diff_label2;
   char date2[datesize];
 #endif
-  char const *cov[7 + COMMAND_LINE_VARYING];
   char const **diffv, **diffp, **diffpend;      /* argv for subsidiary diff */
   char const **pp, *diffvstr = NULL;
-  struct cbuf commarg;
-  struct delta *target;
+  struct delta *target, *t[2];
+  struct fro *built[2];
+  FILE *out[2];
   char *a, *dcp, **newargv;
-  bool no_diff_means_no_output;
+  bool no_diff_means_no_output, fast;
+  long context;
   register int c;
   const struct program program =
     {
@@ -152,7 +337,7 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
 #if DIFF_L
   file_labels = 0;
 #endif
-  expandarg = suffixarg = versionarg = zonearg = NULL;
+  expandarg = NULL;
   no_diff_means_no_output = true;
   BE (pe) = X_DEFAULT;
 
@@ -250,11 +435,9 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
             BE (quiet) = true;
             break;
           case 'x':
-            suffixarg = *argv;
             BE (pe) = *argv + 2;
             goto option_handled;
           case 'z':
-            zonearg = *argv;
             zone_set (*argv + 2);
             goto option_handled;
           case 'T':
@@ -263,8 +446,7 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
               goto unknown;
             break;
           case 'V':
-            versionarg = *argv;
-            setRCSversion (versionarg);
+            setRCSversion (*argv);
             goto option_handled;
           case 'k':
             expandarg = *argv;
@@ -293,6 +475,10 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
       diffvstr = finish_string (PLEXUS, &len);
     }
 
+  /* Adjacent revisions can be compared using the edit script
+     stored for one of them, if the output format allows.  */
+  fast = fast_format (diffv + 2, diffp, &context);
+
 #if DIFF_L
   diff_label1 = diff_label2 = NULL;
   if (file_labels < 2)
@@ -304,13 +490,6 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
 #endif
   diffpend = diffp;
 
-  cov[1] = PEER_SUPER ();
-  cov[2] = "co";
-  cov[3] = "-q";
-#if !DIFF_L
-  cov[COMMAND_LINE_VARYING - 1] = "-M";
-#endif
-
   /* Now handle all filenames.  */
   if (FLOW (erroneousp))
     cleanup (&exitstatus, &work);
@@ -353,7 +532,7 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
 
         if (!fully_numeric (&numericrev, rev1, work.fro))
           continue;
-        if (! (target = delta_from_ref (numericrev.string)))
+        if (! (target = t[0] = delta_from_ref (numericrev.string)))
           continue;
         xrev1 = target->num;
 #if DIFF_L
@@ -370,7 +549,7 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
                                                 : tip->num),
                                 work.fro))
               continue;
-            if (! (target = delta_from_ref (numericrev.string)))
+            if (! (target = t[1] = delta_from_ref (numericrev.string)))
               continue;
             xrev2 = target->num;
             if (no_diff_means_no_output && xrev1 == xrev2)
@@ -395,32 +574,51 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
           }
 #endif
 
-        commarg = minus_p (xrev1, rev1);
-
-        pp = &cov[COMMAND_LINE_VARYING];
-        *pp++ = commarg.string;
-        if (lexpandarg)
-          *pp++ = lexpandarg;
-        if (suffixarg)
-          *pp++ = suffixarg;
-        if (versionarg)
-          *pp++ = versionarg;
-        if (zonearg)
-          *pp++ = zonearg;
-        *pp++ = REPO (filename);
-        *pp = '\0';
-
         diffp = diffpend;
 #if OPEN_O_BINARY
         if (kws == kwsub_b)
           *diffp++ = "--binary";
 #endif
-        diffp[0] = maketemp (0);
-        if (runv (-1, diffp[0], cov))
+        if (lexpandarg)
+          BE (kws) = str2expmode (lexpandarg + 2);
+        BE (inclusive_of_Locker_in_Id_val) = false;
+        built[0] = built[1] = NULL;
+        if (fast && rev2)
           {
-            RERR ("co failed");
-            continue;
+            struct divvy *space = make_space ("rcsdiff");
+            struct difflines ol, nl;
+            bool done;
+
+            if ((done = stored_diff (space, t, BE (kws) < MIN_UNEXPAND,
+                                     built, &ol, &nl)))
+              {
+                char const *label[2] = { NULL, NULL };
+
+#if DIFF_L
+                label[0] = *diff_label1 + sizeof "--label=" - 1;
+                label[1] = *diff_label2 + sizeof "--label=" - 1;
+#endif
+                diagnose ("retrieving revision %s", xrev1);
+                diagnose ("retrieving revision %s", xrev2);
+                diagnose ("diff%s -r%s -r%s", diffvstr, xrev1, xrev2);
+                if (diff_show (stdout, &ol, &nl, context, label)
+                    && DIFF_SUCCESS == exitstatus)
+                  exitstatus = DIFF_FAILURE;
+              }
+            close_space (space);
+            if (done)
+              {
+                fro_zclose (&built[0]);
+                fro_zclose (&built[1]);
+                continue;
+              }
           }
+        /* Build the revisions as "co -q -pREV" would, but in-process,
+           both in one pass if there are two.  */
+        diagnose ("retrieving revision %s", xrev1);
+        t[0]->name = namedrev (rev1, t[0]);
+        if (!(out[0] = fopen_safer (diffp[0] = maketemp (0), FOPEN_W_WORK)))
+          fatal_sys (diffp[0]);
         if (!rev2)
           {
             diffp[1] = mani_filename;
@@ -432,19 +630,36 @@ rcsdiff_main (const char *cmd, int argc, char **argv)
           }
         else
           {
-            commarg = minus_p (xrev2, rev2);
-            cov[COMMAND_LINE_VARYING] = commarg.string;
-            diffp[1] = maketemp (1);
-            if (runv (-1, diffp[1], cov))
-              {
-                RERR ("co failed");
-                continue;
-              }
+            diagnose ("retrieving revision %s", xrev2);
+            t[1]->name = namedrev (rev2, t[1]);
+            if (!(out[1] = fopen_safer (diffp[1] = maketemp (1),
+                                        FOPEN_W_WORK)))
+              fatal_sys (diffp[1]);
           }
+        /* Don't build again a revision that ‘stored_diff’ built.  */
+        if (built[0])
+          {
+            fro_spew (built[0], out[0]);
+            buildrevisions (1, &t[1], &out[1], BE (kws) < MIN_UNEXPAND);
+          }
+        else if (built[1])
+          {
+            fro_spew (built[1], out[1]);
+            buildrevisions (1, t, out, BE (kws) < MIN_UNEXPAND);
+          }
+        else
+          buildrevisions (revnums == 2 ? 2 : 1, t, out,
+                          BE (kws) < MIN_UNEXPAND);
+        fro_zclose (&built[0]);
+        fro_zclose (&built[1]);
+        Ozclose (&out[0]);
         if (!rev2)
           diagnose ("diff%s -r%s %s", diffvstr, xrev1, mani_filename);
         else
-          diagnose ("diff%s -r%s -r%s", diffvstr, xrev1, xrev2);
+          {
+            Ozclose (&out[1]);
+            diagnose ("diff%s -r%s -r%s", diffvstr, xrev1, xrev2);
+          }
 
         diffp[2] = 0;
         {
@@ -45,6 +45,7 @@
 #include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
+#include "b-grok.h"
 #include "b-isr.h"
 #include "b-kwxout.h"
 
@@ -56,29 +57,41 @@
 
 struct editstuff
 {
-  struct fro *fedit;
-  char const *filename;
-  /* Edit file stream and filename.  */
-
+  struct atat const *script;
   size_t script_lno;
-  /* Line number of the current edit script (for error reporting).  */
+  /* The current edit script, and the line number (relative to its
+     start) of the current edit command, for error reporting.  */
 
   long lcount;
   /* Edit line counter; #lines before cursor.  */
   long corr;
   /* #adds - #deletes in each edit run, used to correct ‘es->lcount’
-     in case file is not rewound after applying one delta.  */
+     at the start of the next one.  */
 
-  char **line;
-  size_t gap, gapsize, lim;
-  /* ‘line’ contains pointers to the lines in the currently "edited" file.
-     It is a 0-origin array that represents ‘lim - gapsize’ lines.
-     ‘line[0 .. gap-1]’ and ‘line[gap+gapsize .. lim-1]’ hold pointers to lines.
-     ‘line[gap .. gap+gapsize-1]’ contains garbage.
+  off_t *line;
+  size_t nline, lim;
+  /* ‘line[0 .. nline-1]’ holds the positions in ‘FLOW (from)’ of every
+     line entered since the last ‘enterstring’, in order of arrival;
+     ‘lim’ is its allocated size.  Entries are only ever appended, never
+     moved or overwritten.  Thus, all the deltas applied so far compose
+     into a single edit of the base text, which is read just once (by
+     ‘finishedit’), whether or not ‘FLOW (from)’ is in memory.
 
      Any '@'s in lines are duplicated.  Lines are terminated by '\n',
      or (for a last partial line only) by single '@'.  */
 
+  struct piece *root;
+  struct divvy *pieces;
+  unsigned long seed;
+  /* The currently "edited" file is the in-order concatenation of the
+     runs of ‘line’ described by the pieces of the treap at ‘root’
+     (allocated in ‘pieces’), plus the pending run, below.  Piece
+     priorities come from ‘seed’.  */
+
+  size_t pend_at, pend_beg, pend_count;
+  /* Lines just inserted and not yet in the treap: ‘pend_count’ entries
+     of ‘line’ starting at ‘pend_beg’, to go before line ‘pend_at’.  */
+
   struct sff *sff;
 };
 
@@ -95,6 +108,8 @@ void
 unmake_editstuff (struct editstuff *es)
 {
   free (es->line);
+  if (es->pieces)
+    close_space (es->pieces);
   memset (es, 0, sizeof (struct editstuff));
 }
 
@@ -136,7 +151,12 @@ un_link (char const *s)
 }
 
 #undef SYNTAX_ERROR
-#define SYNTAX_ERROR(...)  fatal_syntax (es->script_lno, __VA_ARGS__)
+#define SCRIPT_LNO(es)  ((es)->script_lno                       \
+                         + ((es)->script                        \
+                            ? atat_lno ((es)->script)           \
+                            : 0))
+
+#define SYNTAX_ERROR(...)  fatal_syntax (SCRIPT_LNO (es), __VA_ARGS__)
 
 #define EDIT_SCRIPT_SHORT()  \
   SYNTAX_ERROR ("edit script ends prematurely")
@@ -147,298 +167,340 @@ un_link (char const *s)
 /* At present, a line is a simple buffer.  In the future, to support
    "annotate" functionality, a line will be a struct that additionally
    contains origin information.  */
-#define SIZEOF_NLINES(n)  ((n) * sizeof (char *))
+#define SIZEOF_NLINES(n)  ((n) * sizeof (off_t))
 
-#define movelines(s1, s2, n)  memmove (s1, s2, SIZEOF_NLINES (n))
+/* The edit buffer is a piece table over ‘es->line’, kept as a treap
+   (randomized binary search tree) ordered by position in the file, so
+   that inserting or deleting at any line takes logarithmic time no
+   matter how far it is from the previous edit.  */
 
-static void
-insertline (struct editstuff *es, unsigned long n, char *l)
-/* Before line ‘n’, insert line ‘l’.  */
+struct piece
 {
-  if (es->lim - es->gapsize < n)
-    EDIT_SCRIPT_OVERFLOW ();
-  if (!es->gapsize)
-    es->line = okalloc
-      (!es->lim
-       ? malloc (SIZEOF_NLINES (es->lim = es->gapsize = 1024))
-       : (es->gap = es->gapsize = es->lim,
-          realloc (es->line, SIZEOF_NLINES (es->lim <<= 1))));
-  if (n < es->gap)
-    movelines (es->line + n + es->gapsize,
-               es->line + n,
-               es->gap - n);
-  else if (es->gap < n)
-    movelines (es->line + es->gap,
-               es->line + es->gap + es->gapsize,
-               n - es->gap);
-
-  es->line[n] = l;
-  es->gap = n + 1;
-  es->gapsize--;
-}
+  struct piece *left, *right;
+  unsigned long prio;
+  size_t beg, count;                    /* run of ‘es->line’ */
+  size_t size;                          /* total lines in subtree */
+};
+
+#define PSIZE(p)  ((p) ? (p)->size : 0)
 
 static void
-deletelines (struct editstuff *es, unsigned long n, unsigned long nlines)
-/* Delete lines ‘n’ through ‘n + nlines - 1’.  */
+resize_piece (struct piece *p)
 {
-  unsigned long l = n + nlines;
+  p->size = PSIZE (p->left) + p->count + PSIZE (p->right);
+}
 
-  if (es->lim - es->gapsize < l || l < n)
-    EDIT_SCRIPT_OVERFLOW ();
-  if (l < es->gap)
-    movelines (es->line + l + es->gapsize,
-               es->line + l,
-               es->gap - l);
-  else if (es->gap < n)
-    movelines (es->line + es->gap,
-               es->line + es->gap + es->gapsize,
-               n - es->gap);
-
-  es->gap = n;
-  es->gapsize += nlines;
+static struct piece *
+new_piece (struct editstuff *es, size_t beg, size_t count)
+{
+  struct piece *p = alloc (es->pieces, "piece", sizeof (struct piece));
+
+  /* xorshift */
+  es->seed ^= es->seed << 13;
+  es->seed ^= es->seed >> 7;
+  es->seed ^= es->seed << 17;
+  p->prio = es->seed;
+  p->left = p->right = NULL;
+  p->beg = beg;
+  p->size = p->count = count;
+  return p;
 }
 
-static void
-snapshotline (register FILE *f, register char *l)
+static struct piece *
+join_pieces (struct piece *a, struct piece *b)
+/* Return the concatenation of ‘a’ and ‘b’.  */
 {
-  register int c;
-  do
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (a->prio > b->prio)
     {
-      if ((c = *l++) == SDELIM && *l++ != SDELIM)
-        return;
-      aputc (c, f);
+      a->right = join_pieces (a->right, b);
+      resize_piece (a);
+      return a;
     }
-  while (c != '\n');
+  b->left = join_pieces (a, b->left);
+  resize_piece (b);
+  return b;
 }
 
-static void
-snapshotedit_fast (struct editstuff *es, FILE *f)
-/* Copy the current state of the edits to ‘f’.  */
+static struct piece *
+split_pieces (struct editstuff *es, struct piece *p, size_t n,
+              struct piece **rest)
+/* Split ‘p’ after its first ‘n’ lines, splitting a piece if need be.
+   Return the first part; set ‘*rest’ to the remainder.  */
 {
-  register char **p, **lim, **l = es->line;
+  size_t left;
 
-  for (p = l, lim = l + es->gap; p < lim;)
-    snapshotline (f, *p++);
-  for (p += es->gapsize, lim = l + es->lim; p < lim;)
-    snapshotline (f, *p++);
+  if (!p)
+    {
+      *rest = NULL;
+      return NULL;
+    }
+  left = PSIZE (p->left);
+  if (n <= left)
+    {
+      struct piece *head = split_pieces (es, p->left, n, &p->left);
+
+      resize_piece (p);
+      *rest = p;
+      return head;
+    }
+  if (left + p->count <= n)
+    {
+      p->right = split_pieces (es, p->right, n - left - p->count, rest);
+      resize_piece (p);
+      return p;
+    }
+  n -= left;
+  *rest = new_piece (es, p->beg + n, p->count - n);
+  /* Inherit the priority, to keep the heap property.  */
+  (*rest)->prio = p->prio;
+  (*rest)->right = p->right;
+  resize_piece (*rest);
+  p->count = n;
+  p->right = NULL;
+  resize_piece (p);
+  return p;
 }
 
-struct finctx
+static void
+flush_pending (struct editstuff *es)
+/* Move the pending run, if any, into the treap.  */
 {
-  struct expctx ctx;
-  size_t script_lno;
-};
+  if (es->pend_count)
+    {
+      struct piece *rest, *head;
+
+      head = split_pieces (es, es->root, es->pend_at, &rest);
+      head = join_pieces (head, new_piece (es, es->pend_beg, es->pend_count));
+      es->root = join_pieces (head, rest);
+      es->pend_count = 0;
+    }
+}
 
 static void
-finisheditline (struct finctx *finctx, char *l)
+clearedit (struct editstuff *es)
+/* Empty the edit buffer.  */
 {
-  struct expctx *ctx = &finctx->ctx;
-
-  ctx->from->ptr = l;
-  if (expandline (ctx) < 0)
-    PFATAL ("%s:%zu: error expanding keywords while applying delta %s",
-            REPO (filename), finctx->script_lno, ctx->delta->num);
+  if (es->pieces)
+    forget (es->pieces);
+  else
+    es->pieces = make_space ("pieces");
+  es->root = NULL;
+  es->nline = es->pend_count = 0;
+  if (!es->seed)
+    es->seed = 2463534242UL;
 }
 
 static void
-finishedit_fast (struct editstuff *es, struct delta const *delta,
-                 FILE *outfile, bool done)
-/* Do expansion if ‘delta’ is set, output the state of the edits to
-   ‘outfile’.  But do nothing unless ‘done’ is set (which means we are
-   on the last pass).  */
+insertline (struct editstuff *es, unsigned long n, off_t l)
+/* Before line ‘n’, insert the line at position ‘l’.  */
 {
-  if (done)
+  if (PSIZE (es->root) + es->pend_count < n)
+    EDIT_SCRIPT_OVERFLOW ();
+  if (es->nline == es->lim)
+    es->line = okalloc
+      (realloc (es->line, SIZEOF_NLINES (es->lim = es->lim
+                                         ? es->lim << 1
+                                         : 1024)));
+  if (!es->pend_count
+      || n != es->pend_at + es->pend_count
+      || es->nline != es->pend_beg + es->pend_count)
     {
-      openfcopy (outfile);
-      outfile = FLOW (res);
-      if (!delta)
-        snapshotedit_fast (es, outfile);
-      else
-        {
-          register char **p, **lim, **l = es->line;
-          register struct fro *fin = FLOW (from);
-          char *here = fin->ptr;
-          struct finctx finctx =
-            {
-              .ctx = EXPCTX_1OUT (outfile, fin, true, true),
-              .script_lno = es->script_lno
-            };
-
-          for (p = l, lim = l + es->gap; p < lim;)
-            finisheditline (&finctx, *p++);
-          for (p += es->gapsize, lim = l + es->lim; p < lim;)
-            finisheditline (&finctx, *p++);
-          fin->ptr = here;
-          FINISH_EXPCTX (&finctx.ctx);
-        }
+      flush_pending (es);
+      es->pend_at = n;
+      es->pend_beg = es->nline;
     }
+  es->line[es->nline++] = l;
+  es->pend_count++;
 }
 
-static FILE *
-fopen_update_truncate (char const *name)
-/* Open a temporary NAME for output, truncating any previous contents.  */
+static void
+deletelines (struct editstuff *es, unsigned long n, unsigned long nlines)
+/* Delete lines ‘n’ through ‘n + nlines - 1’.  */
 {
-  if (!STDIO_P (FLOW (from)))
-    return fopen_safer (name, FOPEN_W_WORK);
-  else
-    {
-      if (BAD_FOPEN_WPLUS && PROB (un_link (name)))
-        fatal_sys (name);
-      return fopen_safer (name, FOPEN_WPLUS_WORK);
-    }
+  unsigned long l = n + nlines;
+  struct piece *rest, *head;
+
+  flush_pending (es);
+  if (PSIZE (es->root) < l || l < n)
+    EDIT_SCRIPT_OVERFLOW ();
+  head = split_pieces (es, es->root, n, &rest);
+  /* Drop the middle part.  Its pieces are reclaimed by ‘clearedit’.  */
+  split_pieces (es, rest, nlines, &rest);
+  es->root = join_pieces (head, rest);
 }
 
-void
-openfcopy (FILE *f)
+static struct piece *
+copy_pieces (struct divvy *to, struct piece const *p)
+/* Return a copy of the treap at ‘p’, allocated in ‘to’.  */
 {
-  if (!(FLOW (res) = f))
+  struct piece *q;
+
+  if (!p)
+    return NULL;
+  q = alloc (to, "piece", sizeof (struct piece));
+  *q = *p;
+  q->left = copy_pieces (to, p->left);
+  q->right = copy_pieces (to, p->right);
+  return q;
+}
+
+struct editstuff *
+clone_editstuff (struct editstuff *es)
+/* Return a new edit data structure in the same state as ‘es’,
+   so that the two can go on to apply different deltas.  */
+{
+  struct editstuff *c = make_editstuff ();
+
+  flush_pending (es);
+  *c = *es;
+  if (es->lim)
     {
-      if (!FLOW (result))
-        FLOW (result) = maketemp (2);
-      if (!(FLOW (res) = fopen_update_truncate (FLOW (result))))
-        fatal_sys (FLOW (result));
+      c->line = okalloc (malloc (SIZEOF_NLINES (es->lim)));
+      memcpy (c->line, es->line, SIZEOF_NLINES (es->nline));
+    }
+  if (es->pieces)
+    {
+      c->pieces = make_space ("pieces");
+      c->root = copy_pieces (c->pieces, es->root);
     }
+  return c;
 }
 
+typedef void (*lineproc_t) (void *closure, off_t l);
+
 static void
-swapeditfiles (struct editstuff *es, FILE *outfile)
-/* Swap ‘FLOW (result)’ and ‘es->filename’,
-   set ‘es->fedit’ to manage ‘FLOW (res)’,
-   and rewind ‘es->fedit’ for reading.
-   Set ‘FLOW (res)’ to ‘outfile’ if non-NULL;
-   otherwise, set ‘FLOW (res)’ to be ‘FLOW (result)’
-   opened for reading and writing.  */
+walkedit (struct editstuff *es, struct piece const *p,
+          lineproc_t proc, void *closure)
+/* Call ‘proc’ on each line under ‘p’, in order.  */
 {
-  char const *tmpptr;
-  FILE *stream = FLOW (res);
-  struct fro *f = es->fedit;
-
-  es->lcount = 0;
-  es->corr = 0;
-  if (! f)
+  while (p)
     {
-      f = es->fedit = FZLLOC (struct fro);
-      f->rm = RM_STDIO;
+      walkedit (es, p->left, proc, closure);
+      for (size_t i = p->beg; i < p->beg + p->count; i++)
+        proc (closure, es->line[i]);
+      p = p->right;
     }
-  f->stream = stream;
-  f->end = ftello (stream);
-  rewind (stream);
-  tmpptr = es->filename;
-  es->filename = FLOW (result);
-  FLOW (result) = tmpptr;
-  openfcopy (outfile);
 }
 
+struct finctx
+{
+  struct expctx ctx;
+  struct editstuff *es;
+};
+
 static void
-finishedit_slow (struct editstuff *es, struct delta const *delta,
-                 FILE *outfile, bool done)
-/* Copy the rest of the edit file and close it (if it exists).
-   If ‘delta’, perform keyword substitution at the same time.
-   If ‘done’ is set, we are finishing the last pass.  */
+seekline (struct fro *fin, off_t l)
 {
-  register struct fro *fe;
-  register FILE *fc;
+  /* Successive lines are often adjacent; avoid needless seeks.  */
+  if (l != fro_tello (fin))
+    fro_move (fin, l);
+}
 
-  fe = es->fedit;
-  if (fe)
+static void
+snapshotline (void *closure, off_t l)
+{
+  struct finctx *finctx = closure;
+  register FILE *f = finctx->ctx.to;
+  register struct fro *fin = finctx->ctx.from;
+  int c;
+
+  if (!STDIO_P (fin))
     {
-      fc = FLOW (res);
-      if (delta)
-        {
-          struct expctx ctx = EXPCTX_1OUT (fc, fe, false, true);
+      register char const *p = fin->base + l;
 
-          while (1 < expandline (&ctx))
-            ;
-          FINISH_EXPCTX (&ctx);
+      do
+        {
+          if ((c = *p++) == SDELIM && *p++ != SDELIM)
+            return;
+          aputc (c, f);
         }
-      else
+      while (c != '\n');
+      return;
+    }
+  seekline (fin, l);
+  do
+    {
+      GETCHAR (c, fin);
+      if (c == SDELIM)
         {
-          VERBATIM (fe, ftello (fe->stream));
-          fro_spew (fe, fc);
+          GETCHAR (c, fin);
+          if (c != SDELIM)
+            return;
         }
-      fro_close (fe);
+      aputc (c, f);
     }
-  if (!done)
-    swapeditfiles (es, outfile);
+  while (c != '\n');
 }
 
 static void
-snapshotedit_slow (struct editstuff *es, FILE *f)
-/* Copy the current state of the edits to ‘f’.  */
+finisheditline (void *closure, off_t l)
 {
-  finishedit_slow (es, NULL, NULL, false);
-  fro_spew (es->fedit, f);
-  fro_bob (es->fedit);
+  struct finctx *finctx = closure;
+  struct expctx *ctx = &finctx->ctx;
+
+  seekline (ctx->from, l);
+  if (expandline (ctx) < 0)
+    PFATAL ("%s:%zu: error expanding keywords while applying delta %s",
+            REPO (filename), SCRIPT_LNO (finctx->es), ctx->delta->num);
 }
 
-void
-finishedit (struct editstuff *es, struct delta const *delta,
-            FILE *outfile, bool done)
+static void
+walkedit_from (struct editstuff *es, struct delta const *delta, FILE *f)
+/* Output the current state of the edits to ‘f’, doing keyword
+   expansion if ‘delta’ is set.  Leave ‘FLOW (from)’ positioned
+   as it was.  */
 {
-  (!STDIO_P (FLOW (from))
-   ? finishedit_fast
-   : finishedit_slow) (es, delta, outfile, done);
+  struct fro *fin = FLOW (from);
+  off_t here = fro_tello (fin);
+  struct finctx finctx =
+    {
+      .ctx = EXPCTX_1OUT (f, fin, true, true),
+      .es = es
+    };
+
+  flush_pending (es);
+  walkedit (es, es->root, delta ? finisheditline : snapshotline, &finctx);
+  fro_move (fin, here);
+  FINISH_EXPCTX (&finctx.ctx);
 }
 
 void
-snapshotedit (struct editstuff *es, FILE *f)
+openfcopy (FILE *f)
 {
-  (!STDIO_P (FLOW (from))
-   ? snapshotedit_fast
-   : snapshotedit_slow) (es, f);
+  if (!(FLOW (res) = f))
+    {
+      if (!FLOW (result))
+        FLOW (result) = maketemp (2);
+      if (!(FLOW (res) = fopen_safer (FLOW (result), FOPEN_W_WORK)))
+        fatal_sys (FLOW (result));
+    }
 }
 
-static void
-copylines (struct editstuff *es, register long upto, struct delta const *delta)
-/* Copy input lines ‘es->lcount+1..upto’ from ‘es->fedit’ to ‘FLOW (res)’.
-   If ‘delta’, keyword expansion is done simultaneously.
-   ‘es->lcount’ is updated.  Rewinds a file only if necessary.  */
+void
+finishedit (struct editstuff *es, struct delta const *delta,
+            FILE *outfile, bool done)
+/* Do expansion if ‘delta’ is set, output the state of the edits to
+   ‘outfile’.  But do nothing unless ‘done’ is set (which means we are
+   on the last pass).  */
 {
-  if (!STDIO_P (FLOW (from)))
-    es->lcount = upto;
-  else
+  if (done)
     {
-      int c;
-      register FILE *fc;
-      register struct fro *fe;
-
-      if (upto < es->lcount)
-        {
-          /* Swap files.  */
-          finishedit_slow (es, NULL, NULL, false);
-          /* Assumes edit only during last pass, from the beginning.  */
-        }
-      fe = es->fedit;
-      fc = FLOW (res);
-      if (es->lcount < upto)
-        {
-          struct expctx ctx = EXPCTX_1OUT (fc, fe, false, true);
-
-          if (delta)
-            do
-              {
-                if (expandline (&ctx) <= 1)
-                  EDIT_SCRIPT_OVERFLOW ();
-              }
-            while (++es->lcount < upto);
-          else
-            {
-              do
-                {
-                  do
-                    {
-                      GETCHAR_OR (c, fe, EDIT_SCRIPT_OVERFLOW ());
-                      aputc (c, fc);
-                    }
-                  while (c != '\n');
-                }
-              while (++es->lcount < upto);
-            }
-          FINISH_EXPCTX (&ctx);
-        }
+      openfcopy (outfile);
+      walkedit_from (es, delta, FLOW (res));
     }
 }
 
+void
+snapshotedit (struct editstuff *es, FILE *f)
+/* Copy the current state of the edits to ‘f’.  */
+{
+  walkedit_from (es, NULL, f);
+}
+
 void
 copystring (struct editstuff *es, struct atat *atat)
 /* Copy a string terminated with a single ‘SDELIM’ from ‘FLOW (from)’ to
@@ -450,105 +512,80 @@ copystring (struct editstuff *es, struct atat *atat)
   atat_display (FLOW (res), atat, false);
   if (FLOW (to))
     atat_put (FLOW (to), atat);
-  es->lcount += atat->line_count;
+  es->lcount += atat_line_count (atat);
 }
 
 void
-enterstring (struct editstuff *es, struct atat *atat)
+enterstring (struct editstuff *es, RCS_UNUSED struct atat *atat)
 /* Like ‘copystring’, except the string is
    put into the ‘edit’ data structure.  */
 {
-  if (STDIO_P (FLOW (from)))
-    {
-      char const *filename;
-
-      es->filename = NULL;
-      es->fedit = NULL;
-      es->lcount = es->corr = 0;
-      FLOW (result) = filename = maketemp (1);
-      if (!(FLOW (res) = fopen_update_truncate (filename)))
-        fatal_sys (filename);
-      copystring (es, atat);
-    }
-  else
+  int c;
+  register FILE *frew;
+  register long e, oe;
+  register bool amidline, oamidline;
+  register off_t pos, opos;
+  register struct fro *fin;
+
+  e = 0;
+  clearedit (es);
+  fin = FLOW (from);
+  fro_trundling (false, fin);
+  frew = FLOW (to);
+  GETCHAR (c, fin);
+  if (frew)
+    afputc (c, frew);
+  pos = fro_tello (fin);
+  amidline = false;
+  for (;;)
     {
-      int c;
-      register FILE *frew;
-      register long e, oe;
-      register bool amidline, oamidline;
-      register char *optr;
-      register struct fro *fin;
-
-      e = 0;
-      es->gap = 0;
-      es->gapsize = es->lim;
-      fin = FLOW (from);
-      fro_trundling (false, fin);
-      frew = FLOW (to);
-      GETCHAR (c, fin);
-      if (frew)
-        afputc (c, frew);
-      amidline = false;
-      for (;;)
+      opos = pos++;
+      TEECHAR ();
+      oamidline = amidline;
+      oe = e;
+      switch (c)
         {
-          optr = fin->ptr;
+        case '\n':
+          ++e;
+          amidline = false;
+          break;
+        case SDELIM:
+          pos++;
           TEECHAR ();
-          oamidline = amidline;
-          oe = e;
-          switch (c)
+          if (c != SDELIM)
             {
-            case '\n':
-              ++e;
-              amidline = false;
-              break;
-            case SDELIM:
-              TEECHAR ();
-              if (c != SDELIM)
-                {
-                  /* End of string.  */
-                  es->lcount = e + amidline;
-                  es->corr = 0;
-                  return;
-                }
-              /* fall into */
-            default:
-              amidline = true;
-              break;
+              /* End of string.  */
+              es->lcount = e + amidline;
+              es->corr = 0;
+              return;
             }
-          if (!oamidline)
-            insertline (es, oe, optr);
+          /* fall into */
+        default:
+          amidline = true;
+          break;
         }
+      if (!oamidline)
+        insertline (es, oe, opos);
     }
 }
 
 void
-editstring (struct editstuff *es, struct atat const *script,
-            struct delta const *delta)
-/* Read an edit script from ‘FLOW (from)’ and apply it to the edit file.
-   | -- ‘(STDIO_P (FLOW (from)))’ --
-   | The result is written to ‘FLOW (res)’.
-   | If ‘delta’, keyword expansion is performed simultaneously.
-   | If running out of lines in ‘es->fedit’,
-   | ‘es->fedit’ and ‘FLOW (res)’ are swapped.
-   | ‘es->filename’ is the name of the file that goes with ‘es->fedit’.
-   If ‘FLOW (to)’ is set, the edit script is also copied verbatim
-   to ‘FLOW (to)’.  Assumes that all these files are open.
-   ‘FLOW (result)’ is the name of the file that goes with ‘FLOW (res)’.
-   Assumes the next input character from ‘FLOW (from)’ is the first
-   character of the edit script.  */
+editstring (struct editstuff *es, struct atat const *script)
+/* Read an edit script from ‘FLOW (from)’ and apply it to the edit
+   data structure.  If ‘FLOW (to)’ is set, the edit script is also
+   copied verbatim to ‘FLOW (to)’.  Assumes the next input character
+   from ‘FLOW (from)’ is the first character of the edit script.  */
 {
   int ed;                               /* editor command */
   int c;
   register FILE *frew;
-  register FILE *f = NULL;
-  long line_lim = LONG_MAX;
-  register struct fro *fe;
   register long i;
   register struct fro *fin;
-  register long j = 0;
+  register long j;
   struct diffcmd dc;
 
-  es->script_lno = script->lno;
+  es->script = script;
+  es->script_lno = 0;
   es->lcount += es->corr;
   es->corr = 0;                         /* correct line number */
   frew = FLOW (to);
@@ -558,96 +595,44 @@ editstring (struct editstuff *es, struct atat const *script,
     afputc (c, frew);
   initdiffcmd (&dc);
   while (0 <= (ed = getdiffcmd (fin, true, frew, &dc)))
-    if (STDIO_P (fin)
-        && line_lim <= dc.line1)
-      EDIT_SCRIPT_OVERFLOW ();
-    else if (!ed)
+    if (!ed)
       {
-        copylines (es, dc.line1 - 1, delta);
+        es->lcount = dc.line1 - 1;
         /* Skip over unwanted lines.  */
         i = dc.nlines;
         es->corr -= i;
         es->lcount += i;
-        if (!STDIO_P (fin))
-          deletelines (es, es->lcount + es->corr, i);
-        else
-          {
-            fe = es->fedit;
-            do
-              {
-                /* Skip next line.  */
-                do GETCHAR_OR (c, fe,
-                               {
-                                 if (i != 1)
-                                   EDIT_SCRIPT_OVERFLOW ();
-                                 line_lim = dc.dafter;
-                                 goto done;
-                               });
-                while (c != '\n');
-              done:
-                ;
-              }
-            while (--i);
-          }
+        deletelines (es, es->lcount + es->corr, i);
         es->script_lno++;
       }
     else
       {
         /* Copy lines without deleting any.  */
-        copylines (es, dc.line1, delta);
+        es->lcount = dc.line1;
         i = dc.nlines;
-        if (!STDIO_P (fin))
-          j = es->lcount + es->corr;
+        j = es->lcount + es->corr;
         es->corr += i;
-        if (STDIO_P (fin)
-            && (f = FLOW (res),
-                delta))
-          {
-            struct expctx ctx = EXPCTX (f, frew, fin, true, true);
-
-            do
-              {
-                switch (expandline (&ctx))
-                  {
-                  case 0:
-                  case 1:
-                    if (i == 1)
-                      return;
-                    /* fall into */
-                  case -1:
-                    EDIT_SCRIPT_SHORT ();
-                  }
-              }
-            while (--i);
-            FINISH_EXPCTX (&ctx);
-          }
-        else
+        do
           {
-            do
+            insertline (es, j++, fro_tello (fin));
+            for (;;)
               {
-                if (!STDIO_P (fin))
-                  insertline (es, j++, fin->ptr);
-                for (;;)
+                TEECHAR ();
+                if (c == SDELIM)
                   {
                     TEECHAR ();
-                    if (c == SDELIM)
+                    if (c != SDELIM)
                       {
-                        TEECHAR ();
-                        if (c != SDELIM)
-                          {
-                            if (--i)
-                              EDIT_SCRIPT_SHORT ();
-                            return;
-                          }
+                        if (--i)
+                          EDIT_SCRIPT_SHORT ();
+                        return;
                       }
-                    if (STDIO_P (fin))
-                      aputc (c, f);
-                    if (c == '\n')
-                      break;
                   }
+                if (c == '\n')
+                  break;
               }
-            while (--i);
           }
+        while (--i);
         es->script_lno += 1 + dc.nlines;
       }
 }
@@ -1024,41 +1009,24 @@ addsymbol (char const *num, char const *name, bool rebind)
    with ‘num’; otherwise, print an error message and return false;
    Return -1 if unsuccessful, 0 if no change, 1 if change.  */
 {
-  struct link box, *tp;
+  struct symdef const *dk = grok_symbol (REPO (r), name, strlen (name));
   struct symdef *d;
 
-#define MAKEDEF()                               \
-  d = FALLOC (struct symdef);                   \
-  d->meaningful = name;                         \
-  d->underlying = num
-
-  box.next = GROK (symbols);
-  for (tp = &box; tp->next; tp = tp->next)
+  if (dk)
     {
-      struct symdef const *dk = tp->next->entry;
-
-      if (STR_SAME (name, dk->meaningful))
+      if (STR_SAME (dk->underlying, num))
+        return 0;
+      if (!rebind)
         {
-          if (STR_SAME (dk->underlying, num))
-            return 0;
-          else if (rebind)
-            {
-              MAKEDEF ();
-              tp->next = prepend (d, tp->next->next, SINGLE);
-              goto ok;
-            }
-          else
-            {
-              RERR ("symbolic name %s already bound to %s",
-                    name, dk->underlying);
-              return -1;
-            }
+          RERR ("symbolic name %s already bound to %s",
+                name, dk->underlying);
+          return -1;
         }
     }
-  MAKEDEF ();
-  box.next = prepend (d, box.next, SINGLE);
- ok:
-  GROK (symbols) = box.next;
+  d = FALLOC (struct symdef);
+  d->meaningful = name;
+  d->underlying = num;
+  grok_symbol_set (REPO (r), d);
   return 1;
 }
 
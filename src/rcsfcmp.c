@@ -40,17 +40,44 @@ discardkeyval (int c, register struct fro *f)
       }
 }
 
+static bool
+same_run (struct fro *xfp, struct fro *ufp, size_t *leaderlen)
+/* Both ‘xfp’ and ‘ufp’ are in memory.  Compare the bytes before the
+   next ‘KDELIM’ in ‘xfp’ (or before the end of the shorter file) with
+   as many bytes of ‘ufp’, all at once.  If they are the same, skip
+   them in both, update ‘*leaderlen’ as the byte-by-byte loop in
+   ‘rcsfcmp’ would, and return true.  Otherwise, return false.  */
+{
+  char const *x = xfp->ptr;
+  size_t xavail = xfp->lim - x, uavail = ufp->lim - ufp->ptr;
+  size_t n = xavail < uavail ? xavail : uavail;
+  char const *kd = memchr (x, KDELIM, n);
+  size_t len = kd ? (size_t) (kd - x) : n;
+  char const *nl = x + len;
+
+  if (MEM_DIFF (len, x, ufp->ptr))
+    return false;
+  while (x < nl && '\n' != nl[-1])
+    nl--;
+  *leaderlen = (x < nl ? 0 : *leaderlen) + (x + len - nl);
+  xfp->ptr += len;
+  ufp->ptr += len;
+  return true;
+}
+
 int
 rcsfcmp (register struct fro *xfp, struct stat const *xstatp,
-         char const *uname, struct delta const *delta)
-/* Compare the files ‘xfp’ and ‘uname’.  Return zero if ‘xfp’ has the
-   same contents as ‘uname’ and neither has keywords, otherwise -1 if
-   they are the same ignoring keyword values, and 1 if they differ even
-   ignoring keyword values.  For the ‘Log’ keyword, skip the log message
-   given by the parameter ‘delta’ in ‘xfp’.  Thus, return nonpositive if
-   ‘xfp’ contains the same as ‘uname’, with the keywords expanded.
+         register struct fro *ufp, struct delta const *delta)
+/* Compare the files ‘xfp’ and ‘ufp’ (which the caller must close).
+   Return zero if ‘xfp’ has the same contents as ‘ufp’ and neither has
+   keywords, otherwise -1 if they are the same ignoring keyword values,
+   and 1 if they differ even ignoring keyword values.  For the ‘Log’
+   keyword, skip the log message given by the parameter ‘delta’ in
+   ‘xfp’.  Thus, return nonpositive if ‘xfp’ contains the same as
+   ‘ufp’, with the keywords expanded.
 
-   Implementation: character-by-character comparison until $ is found.
+   Implementation: character-by-character comparison until $ is found
+   (or, if both files are in memory, block comparison; see ‘same_run’).
    If a $ is found, read in the marker keywords; if they are real
    keywords and identical, read in keyword value. If value is terminated
    properly, disregard it and optionally skip log message; otherwise,
@@ -59,23 +86,17 @@ rcsfcmp (register struct fro *xfp, struct stat const *xstatp,
   int xc, uc;
   char xkeyword[keylength + 2];
   bool eqkeyvals;
-  register struct fro *ufp;
   register bool xeof, ueof;
   register char *tp;
   register char const *sp;
-  register size_t leaderlen;
+  size_t leaderlen;
   int result;
   struct pool_found match1;
-  struct stat ustat;
 
-  if (!(ufp = fro_open (uname, FOPEN_R_WORK, &ustat)))
-    {
-      fatal_sys (uname);
-    }
   xeof = ueof = false;
   if (MIN_UNEXPAND <= BE (kws))
     {
-      if (!(result = xstatp->st_size != ustat.st_size))
+      if (!(result = xstatp->st_size != ufp->end))
         {
           /* The fast path is possible only if neither file uses stdio.  */
           if (RM_STDIO != xfp->rm
@@ -96,6 +117,8 @@ rcsfcmp (register struct fro *xfp, struct stat const *xstatp,
     }
   else
     {
+      bool memp = !STDIO_P (xfp) && !STDIO_P (ufp);
+
       xc = 0;
       uc = 0;                   /* Keep lint happy.  */
       leaderlen = 0;
@@ -105,6 +128,9 @@ rcsfcmp (register struct fro *xfp, struct stat const *xstatp,
         {
           if (xc != KDELIM)
             {
+              /* Skip what is the same up to the next ‘KDELIM’.  */
+              if (memp && !same_run (xfp, ufp, &leaderlen))
+                goto return1;
               /* Get the next characters.  */
               GETCHAR_OR (xc, xfp, xeof = true);
               GETCHAR_OR (uc, ufp, ueof = true);
@@ -262,7 +288,6 @@ eof:
 return1:
   result = 1;
 returnresult:
-  fro_close (ufp);
   return result;
 }
 
@@ -250,6 +250,55 @@ fin2open (char const *d, size_t dlen,
 #undef ACC
 }
 
+static bool
+workname_pairs (char const *base, size_t baselen, char const *name)
+/* Return true if ‘name’ is the name of a working file (not an
+   RCS file) whose basename is ‘base’ (‘baselen’ bytes).  */
+{
+  size_t len = strlen (name);
+  char const *p;
+
+  return !rcssuffix (name)
+    && baselen <= len
+    && ((p = name + len - baselen) == name || isSLASH (p[-1]))
+    && MEM_SAME (baselen, base, p);
+}
+
+static char *
+rcsname_pairs (char const *base, size_t baselen, char *name)
+/* If ‘name’ is the name of an RCS file for the working file
+   whose basename is ‘base’ (‘baselen’ bytes), return the start
+   of that basename in ‘name’.  Otherwise, return NULL.  */
+{
+  char const *x = rcssuffix (name);
+  char *p;
+
+  return x
+    && name + baselen <= x
+    && ((p = name + (x - name) - baselen) == name || isSLASH (p[-1]))
+    && MEM_SAME (baselen, base, p)
+    ? p
+    : NULL;
+}
+
+int
+pair_span (int argc, char **argv)
+/* Return 2 if ‘pairnames’ would take ‘argv[0]’ and ‘argv[1]’
+   together (an RCS file and its working file, in either order),
+   otherwise 1.  ‘argc’ indicates how many filenames there are.  */
+{
+  char const *arg = argv[0], *base, *x;
+
+  if (argc < 2 || !arg || '-' == *arg || !argv[1])
+    return 1;
+  base = basefilename (arg);
+  return ((x = rcssuffix (arg))
+          ? workname_pairs (base, x - base, argv[1])
+          : !!rcsname_pairs (base, strlen (base), argv[1]))
+    ? 2
+    : 1;
+}
+
 int
 pairnames (int argc, char **argv, open_rcsfile_fn *rcsopen,
            bool mustread, bool quiet)
@@ -271,7 +320,7 @@ pairnames (int argc, char **argv, open_rcsfile_fn *rcsopen,
   char const *base, *RCSbase, *x;
   char *mani_filename;
   bool paired;
-  size_t arglen, dlen, baselen, xlen;
+  size_t dlen, baselen, xlen;
   struct fro *from;
   struct maybe maybe =
     {
@@ -302,10 +351,7 @@ pairnames (int argc, char **argv, open_rcsfile_fn *rcsopen,
       RCSbase = base;
       baselen = x - base;
       if (1 < argc
-          && !rcssuffix (mani_filename = p = argv[1])
-          && baselen <= (arglen = (size_t) strlen (p))
-          && ((p += arglen - baselen) == mani_filename || isSLASH (p[-1]))
-          && MEM_SAME (baselen, base, p))
+          && workname_pairs (base, baselen, mani_filename = argv[1]))
         {
           argv[1] = NULL;
           paired = true;
@@ -323,11 +369,9 @@ pairnames (int argc, char **argv, open_rcsfile_fn *rcsopen,
       baselen = strlen (base);
       /* Derive RCS filename.  */
       if (1 < argc
-          && (x = rcssuffix (RCS1 = argv[1]))
-          && RCS1 + baselen <= x
-          && ((RCSbase = x - baselen) == RCS1 || isSLASH (RCSbase[-1]))
-          && MEM_SAME (baselen, base, RCSbase))
+          && (RCSbase = rcsname_pairs (base, baselen, RCS1 = argv[1])))
         {
+          x = RCSbase + baselen;
           argv[1] = NULL;
           paired = true;
         }
@@ -24,17 +24,25 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <obstack.h>
+#include "stat-time.h"
+#include "timespec.h"
 #include "b-complain.h"
+#include "b-diff.h"
 #include "b-divvy.h"
 #include "b-esds.h"
 #include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
+#include "b-grok.h"
 #include "b-kwxout.h"
+#include "b-scan.h"
 
 enum stringwork
-{ enter, copy, edit, expand, edit_expand };
+{ enter, copy, edit, expand };
 
 static void
 scandeltatext (struct editstuff *es, struct wlink **ls,
@@ -101,14 +109,321 @@ scandeltatext (struct editstuff *es, struct wlink **ls,
       }
       break;
     case edit:
-      editstring (es, text, NULL);
-      break;
-    case edit_expand:
-      editstring (es, text, delta);
+      editstring (es, text);
       break;
     }
 }
 
+/* Revision cache.
+
+   If ‘BE (rev_cache)’ names a directory, ‘buildrevision’ saves there
+   the unexpanded text of each revision that it has to build from more
+   than one delta, and reads it back (doing keyword expansion, if
+   need be) on the next call for the same revision of the same RCS
+   file, instead of applying the deltas again.  The cache file is named
+   for the device and inode of the RCS file and the revision number,
+   and begins with a header that also carries the size, mtime and ctime
+   of the RCS file; any mismatch means a miss.  So does a cache file
+   that someone else could have written (see ‘cache_open’).  Every hit
+   refreshes the mtime of the cache file, and every save removes the
+   files with the oldest mtime until the total is at most
+   ‘BE (rev_cache_size)’ kilobytes.  To avoid scanning the directory
+   on every save, the total is kept in the file ‘RCACHE_TOTAL’ there,
+   and a save scans only if that file is missing or the new total
+   exceeds the limit.  The update is not locked, so concurrent saves
+   can lose one another's sizes (and a file removed by hand is never
+   subtracted); the total is thus only approximate, until the scan
+   records the actual total.  Lookup and eviction failures are
+   silently ignored.  */
+
+#define RCACHE_MAGIC    "RCSrev"
+#define RCACHE_VERSION  3
+#define RCACHE_SUFFIX   ".rev"
+#define RCACHE_TOTAL    ".total"
+
+static char const *
+rcache_filename (struct divvy *space, struct stat const *st,
+                 char const *revno)
+{
+  size_t len;
+
+  accf (space, "%s%c%lx-%lx-%s" RCACHE_SUFFIX, BE (rev_cache), SLASH,
+        (unsigned long) st->st_dev, (unsigned long) st->st_ino, revno);
+  return finish_string (space, &len);
+}
+
+static struct fro *
+rcache_open (struct stat const *st, char const *revno)
+/* Return the cache file for ‘revno’, positioned (and ‘VERBATIM’)
+   just past the header, or NULL if there is none that matches ‘st’.  */
+{
+  struct divvy *space = make_space ("rcache");
+  char const *filename = rcache_filename (space, st, revno);
+  struct cache_key key, want;
+  unsigned char *p = (unsigned char *) &key;
+  struct stat cst;
+  struct fro *f = NULL;
+  int c, fd;
+
+  if (! PROB (fd = cache_open (BE (rev_cache), filename, &cst))
+      && (f = fro_fdopen (fd, filename, FOPEN_RB, &cst)))
+    {
+      if (cst.st_size < (off_t) sizeof (key))
+        goto bad;
+      for (size_t i = 0; i < sizeof (key); i++)
+        {
+          GETCHAR_OR (c, f, goto bad);
+          p[i] = c;
+        }
+      cache_set_key (&want, RCACHE_MAGIC, RCACHE_VERSION, st);
+      if (! MEM_SAME (sizeof (key), &key, &want))
+        goto bad;
+      VERBATIM (f, sizeof (key));
+      /* Note the use, for eviction.  */
+      setmtime (filename, BE (now));
+    }
+  close_space (space);
+  return f;
+
+ bad:
+  fro_close (f);
+  close_space (space);
+  return NULL;
+}
+
+static char const *
+rcache_total_filename (struct divvy *space)
+{
+  size_t len;
+
+  accf (space, "%s%c" RCACHE_TOTAL, BE (rev_cache), SLASH);
+  return finish_string (space, &len);
+}
+
+static off_t
+rcache_total (struct divvy *space)
+/* Return the total recorded in ‘RCACHE_TOTAL’, or -1 if there is none.  */
+{
+  long long total = -1;
+  struct stat st;
+  FILE *f;
+  int fd;
+
+  if (! PROB (fd = cache_open (BE (rev_cache),
+                               rcache_total_filename (space), &st)))
+    {
+      if (!(f = fdopen (fd, "r")))
+        close (fd);
+      else
+        {
+          if (1 != fscanf (f, "%lld", &total))
+            total = -1;
+          fclose (f);
+        }
+    }
+  return total;
+}
+
+static void
+rcache_write_total (FILE *f, void const *data)
+{
+  off_t const *total = data;
+
+  fprintf (f, "%lld\n", (long long) *total);
+}
+
+static void
+rcache_set_total (struct divvy *space, off_t total)
+{
+  cache_write (rcache_total_filename (space), rcache_write_total, &total);
+}
+
+struct rcache_entry
+{
+  char const *name;
+  off_t size;
+  struct timespec mtime;
+};
+
+static int
+rcache_older (void const *a, void const *b)
+{
+  struct rcache_entry const *x = a, *y = b;
+
+  return timespec_cmp (x->mtime, y->mtime);
+}
+
+static void
+rcache_evict (void)
+/* Remove the least recently used files until the cache
+   is no larger than ‘BE (rev_cache_size)’ kilobytes,
+   and record the resulting total.  */
+{
+  char const *dir = BE (rev_cache);
+  struct divvy *space = make_space ("rcache");
+  struct divvy *entries = make_space ("entries");
+  struct obstack *o = entries->space;
+  struct rcache_entry *v, ent;
+  off_t total = 0, limit = 1024 * BE (rev_cache_size);
+  size_t count = 0, len, slen = sizeof (RCACHE_SUFFIX) - 1;
+  struct dirent *e;
+  struct stat st;
+  DIR *d;
+
+  if (!(d = opendir (dir)))
+    goto done;
+  while ((e = readdir (d)))
+    {
+      char const *en = e->d_name;
+
+      if ((len = strlen (en)) <= slen
+          || !STR_SAME (en + len - slen, RCACHE_SUFFIX))
+        continue;
+      accf (space, "%s%c%s", dir, SLASH, en);
+      ent.name = finish_string (space, &len);
+      if (PROB (stat (ent.name, &st)))
+        continue;
+      ent.size = st.st_size;
+      ent.mtime = get_stat_mtime (&st);
+      total += ent.size;
+      obstack_grow (o, &ent, sizeof (ent));
+      count++;
+    }
+  closedir (d);
+  if (limit < total)
+    {
+      v = obstack_finish (o);
+      qsort (v, count, sizeof (*v), rcache_older);
+      for (size_t i = 0; i < count && limit < total; i++)
+        if (!PROB (unlink (v[i].name)))
+          total -= v[i].size;
+    }
+  rcache_set_total (space, total);
+ done:
+  close_space (entries);
+  close_space (space);
+}
+
+struct rcache_image
+{
+  struct cache_key key;
+  struct editstuff *es;
+};
+
+static void
+rcache_write_image (FILE *f, void const *data)
+{
+  struct rcache_image const *image = data;
+
+  awrite ((char const *) &image->key, sizeof (image->key), f);
+  snapshotedit (image->es, f);
+}
+
+static void
+rcache_save (struct editstuff *es, struct stat const *st,
+             char const *revno)
+/* Save the current state of the edits as the text of ‘revno’.  */
+{
+  struct divvy *space = make_space ("rcache");
+  char const *filename = rcache_filename (space, st, revno);
+  struct rcache_image image = { .es = es };
+  off_t total, size, stale = 0;
+  struct stat cst;
+
+  cache_set_key (&image.key, RCACHE_MAGIC, RCACHE_VERSION, st);
+  /* A file by that name (for an older state of the
+     RCS file) is about to be replaced; don't count it.  */
+  if (! PROB (stat (filename, &cst)))
+    stale = cst.st_size;
+  if (! PROB (size = cache_write (filename, rcache_write_image, &image)))
+    {
+      if (! PROB (total = rcache_total (space)))
+        total += size - stale;
+      if (PROB (total) || 1024 * BE (rev_cache_size) < total)
+        rcache_evict ();
+      else
+        rcache_set_total (space, total);
+    }
+  close_space (space);
+}
+
+static void
+spew_text (struct fro *cached, off_t beg, struct delta *target,
+           FILE *outfile, bool expandflag)
+/* Output the text of ‘target’, which is the contents of ‘cached’ from
+   position ‘beg’, with ‘VERBATIM’ there (e.g., a revision cache file),
+   to ‘outfile’ (see ‘openfcopy’), then close ‘cached’.  */
+{
+  struct delta *delta = target;
+  struct range text =
+    {
+      .beg = beg,
+      .end = cached->end
+    };
+
+  delta->pretty_log = string_from_atat (SINGLE, delta->log);
+  delta->pretty_log = cleanlogmsg (delta->pretty_log.string,
+                                   delta->pretty_log.size);
+  openfcopy (outfile);
+  /* Without ‘KDELIM’, there is nothing to expand.  */
+  if (expandflag && fro_has_kdelim (cached, &text))
+    {
+      struct expctx ctx = EXPCTX_1OUT (FLOW (res), cached, false, true);
+
+      ctx.beg = beg;
+      fro_move (cached, beg);
+      while (1 < expandline (&ctx))
+        continue;
+      FINISH_EXPCTX (&ctx);
+    }
+  else
+    fro_spew (cached, FLOW (res));
+  fro_close (cached);
+}
+
+static bool
+memo_head (struct delta *target, FILE *outfile, bool expandflag)
+/* If the text of ‘target’, the head revision, is kept in memory
+   with the parse of the RCS file (see ‘gmemo’), or can be put there,
+   output it from there, like ‘spew_text’, and return true.  */
+{
+  struct stat st;
+  struct cbuf text;
+
+  if (! gmemo
+      || FLOW (to)
+      || PROB (fstat (FLOW (from)->fd, &st)))
+    return false;
+  if (! gmemo_head (&st, &text))
+    {
+      struct divvy *space = make_space ("head");
+
+      gmemo_put_head (&st, string_from_atat (space, target->text));
+      close_space (space);
+      if (! gmemo_head (&st, &text))
+        return false;
+    }
+  spew_text (fro_memview (text.string, text.size), 0, target,
+             outfile, expandflag);
+  return true;
+}
+
+bool
+chain_has_kdelim (struct wlink const *chain)
+/* Return true if the text of any delta in ‘chain’ might contain
+   ‘KDELIM’, in which case a revision built from those deltas might
+   contain keywords (see ‘atat_has_kdelim’).  */
+{
+  for (; chain; chain = chain->next)
+    {
+      struct delta const *d = chain->entry;
+
+      if (atat_has_kdelim (d->text))
+        return true;
+    }
+  return false;
+}
+
 char const *
 buildrevision (struct wlink const *deltas, struct delta *target,
                FILE *outfile, bool expandflag)
@@ -119,22 +434,45 @@ buildrevision (struct wlink const *deltas, struct delta *target,
    keyword expansion is performed.  Return NULL if ‘outfile’ is set, the
    name of the temporary file otherwise.
 
-   Algorithm: Copy initial revision unchanged.  Then edit all revisions
-   but the last one into it, alternating input and output files
-   (‘FLOW (result)’ and ‘editname’).  The last revision is then edited in,
-   performing simultaneous keyword substitution (this saves one extra
-   pass).  All this simplifies if only one revision needs to be generated,
-   or no keyword expansion is necessary, or if output goes to stdout.  */
+   Algorithm: Enter the initial revision into the edit data structure.
+   Then apply the edit script of each subsequent revision, composing
+   them into a single edit of the initial revision.  Finally, output
+   the result in one pass, performing keyword substitution along the
+   way.  If only one revision needs to be generated, simply copy it.
+   If the revision is in the revision cache (see above), use that;
+   likewise, for the head revision, its text kept in memory, if any
+   (see ‘memo_head’).
+   Skip keyword substitution if no delta involved contains ‘KDELIM’;
+   the output is then written in bulk.  */
 {
   struct editstuff *es = make_editstuff ();
   struct wlink *ls = GROK (deltas);
+  struct fro *cached = NULL;
+  struct stat st;
+  bool cachep;
+
+  if (expandflag)
+    expandflag = chain_has_kdelim (deltas);
+
+  /* Don't bother with the cache if there is only one revision
+     to generate, or if the RCS file is being copied as we go.  */
+  cachep = BE (rev_cache)
+    && deltas->entry != target
+    && !FLOW (to)
+    && !PROB (fstat (FLOW (from)->fd, &st));
 
   if (deltas->entry == target)
     {
       /* Only latest revision to generate.  */
-      openfcopy (outfile);
-      scandeltatext (es, &ls, target, expandflag ? expand : copy, true);
+      if (! memo_head (target, outfile, expandflag))
+        {
+          openfcopy (outfile);
+          scandeltatext (es, &ls, target, expandflag ? expand : copy, true);
+        }
     }
+  else if (cachep && (cached = rcache_open (&st, target->num)))
+    spew_text (cached, sizeof (struct cache_key), target,
+               outfile, expandflag);
   else
     {
       /* Several revisions to generate.
@@ -146,12 +484,9 @@ buildrevision (struct wlink const *deltas, struct delta *target,
           /* Do all deltas except last one.  */
           scandeltatext (es, &ls, deltas->entry, edit, false);
         }
-      if (expandflag || outfile)
-        {
-          /* First, get to beginning of file.  */
-          finishedit (es, NULL, outfile, false);
-        }
-      scandeltatext (es, &ls, target, expandflag ? edit_expand : edit, true);
+      scandeltatext (es, &ls, target, edit, true);
+      if (cachep)
+        rcache_save (es, &st, target->num);
       finishedit (es, expandflag ? target : NULL, outfile, true);
     }
   unmake_editstuff (es);
@@ -161,6 +496,179 @@ buildrevision (struct wlink const *deltas, struct delta *target,
   return FLOW (result);
 }
 
+struct fro *
+buildrevision_fro (struct wlink const *deltas, struct delta *target,
+                   bool expandflag, off_t sizehint)
+/* Like ‘buildrevision’ with no ‘outfile’, but return the revision
+   open for reading.  If ‘sizehint’, the expected size of the revision,
+   is small enough for ‘fro_open’ to read the file into memory anyway
+   (see ‘BE (mem_limit)’), build the revision directly into memory,
+   instead of into a temporary file.  */
+{
+  char const *name;
+  struct fro *f;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+  if (sizehint < 1024 * BE (mem_limit))
+    {
+      char *buf;
+      size_t size;
+      FILE *mem = open_memstream (&buf, &size);
+
+      if (mem)
+        {
+          buildrevision (deltas, target, mem, expandflag);
+          /* This closes ‘mem’, too.  */
+          Ozclose (&FLOW (res));
+          return fro_membuf (buf, size);
+        }
+    }
+#endif
+  name = buildrevision (deltas, target, NULL, expandflag);
+  if (!(f = fro_open (name, FOPEN_R_WORK, NULL)))
+    fatal_sys (name);
+  return f;
+}
+
+struct build
+{
+  struct wlink const *chain;
+  /* The deltas still to apply, or NULL when all have been.  */
+
+  struct delta *target;
+  FILE *out;
+
+  bool expandflag;
+  /* Do keyword expansion (see ‘chain_has_kdelim’).  */
+};
+
+struct multictx
+{
+  struct delta *head;
+  bool cachep;
+  struct stat st;
+};
+
+static void
+build_shared (struct multictx const *mc, struct editstuff *es,
+              struct wlink *ls, size_t count, struct build *b)
+/* Apply the remaining deltas of the ‘count’ builds at ‘b’, which
+   have so far been applied to ‘es’ (‘ls’ is where ‘scandeltatext’
+   left off), outputting each target when its chain is done.  Builds
+   that go on to apply different deltas continue on a clone of ‘es’.  */
+{
+  while (count)
+    {
+      struct delta *d;
+      size_t i, n;
+      bool needlog = false;
+
+      /* Output the finished builds and drop them.  */
+      for (i = n = 0; i < count; i++)
+        if (b[i].chain)
+          b[n++] = b[i];
+        else
+          {
+            if (mc->cachep && b[i].target != mc->head)
+              rcache_save (es, &mc->st, b[i].target->num);
+            finishedit (es, b[i].expandflag ? b[i].target : NULL,
+                        b[i].out, true);
+            FLOW (res) = NULL;
+          }
+      if (! (count = n))
+        break;
+
+      /* Move the builds that apply the same delta next to the front.  */
+      d = b[0].chain->entry;
+      for (i = n = 1; i < count; i++)
+        if (d == b[i].chain->entry)
+          {
+            struct build tmp = b[n];
+
+            b[n++] = b[i];
+            b[i] = tmp;
+          }
+      for (i = 0; i < n; i++)
+        if (! (b[i].chain = b[i].chain->next))
+          needlog = true;
+
+      if (n < count)
+        {
+          struct editstuff *fork = clone_editstuff (es);
+          struct wlink *fls = ls;
+
+          scandeltatext (fork, &fls, d, edit, needlog);
+          build_shared (mc, fork, fls, n, b);
+          unmake_editstuff (fork);
+          b += n;
+          count -= n;
+        }
+      else
+        scandeltatext (es, &ls, d, edit, needlog);
+    }
+}
+
+void
+buildrevisions (size_t count, struct delta *target[count],
+                FILE *outfile[count], bool expandflag)
+/* Like ‘buildrevision’, for each of ‘count’ targets, writing the text
+   of ‘target[i]’ to ‘outfile[i]’.  The delta chains leading to the
+   targets share an initial part (at least the tip); apply each delta
+   of that part only once, cloning the edit data structure where the
+   chains diverge.  ‘FLOW (to)’ must not be set.  */
+{
+  struct divvy *space = make_space ("buildrevisions");
+  struct build *b = alloc (space, "builds", count * sizeof (struct build));
+  struct multictx mc;
+  struct wlink *chain;
+  size_t n = 0;
+
+  mc.head = REPO (tip);
+  mc.cachep = BE (rev_cache) && !PROB (fstat (FLOW (from)->fd, &mc.st));
+  for (size_t i = 0; i < count; i++)
+    {
+      struct fro *cached;
+
+      if (mc.cachep && target[i] != mc.head
+          && (cached = rcache_open (&mc.st, target[i]->num)))
+        {
+          spew_text (cached, sizeof (struct cache_key), target[i],
+                     outfile[i], expandflag);
+          FLOW (res) = NULL;
+          continue;
+        }
+      gr_revno (target[i]->num, &chain);
+      b[n++] = (struct build)
+        {
+          .chain = chain,
+          .target = target[i],
+          .out = outfile[i],
+          .expandflag = expandflag && chain_has_kdelim (chain)
+        };
+    }
+
+  if (1 == n)
+    {
+      buildrevision (b[0].chain, b[0].target, b[0].out, expandflag);
+      FLOW (res) = NULL;
+    }
+  else if (n)
+    {
+      struct editstuff *es = make_editstuff ();
+      struct wlink *ls = GROK (deltas);
+      bool needlog = false;
+
+      /* All chains start at the tip.  */
+      for (size_t i = 0; i < n; i++)
+        if (! (b[i].chain = b[i].chain->next))
+          needlog = true;
+      scandeltatext (es, &ls, mc.head, enter, needlog);
+      build_shared (&mc, es, ls, n, b);
+      unmake_editstuff (es);
+    }
+  close_space (space);
+}
+
 struct cbuf
 cleanlogmsg (char const *m, size_t s)
 {
@@ -497,23 +1005,27 @@ putstring (register FILE *out, bool delim, struct cbuf s, bool log)
    ‘SDELIM’s doubled.  If ‘log’ is set then ‘s’ is a log string; append
    a newline if ‘s’ is nonempty.  */
 {
-  register char const *sp;
-  register size_t ss;
-
   if (delim)
     aputc (SDELIM, out);
-  sp = s.string;
-  for (ss = s.size; ss; --ss)
-    {
-      if (*sp == SDELIM)
-        aputc (SDELIM, out);
-      aputc (*sp++, out);
-    }
+  stuff_sdelim (out, s.string, s.size);
   if (s.size && log)
     aputc ('\n', out);
   aputc (SDELIM, out);
 }
 
+static void
+begin_dtext (struct delta const *delta, FILE *fout)
+/* Output a deltatext node up to the opening ‘SDELIM’ of the text.  */
+{
+  aprintf (fout, "\n\n%s\n%s\n", delta->num, TINYKS (log));
+
+  /* Put log.  */
+  putstring (fout, true, delta->pretty_log, true);
+  aputc ('\n', fout);
+  /* Put text.  */
+  aprintf (fout, "%s\n%c", TINYKS (text), SDELIM);
+}
+
 void
 putdftext (struct delta const *delta, struct fro *finfile,
            FILE *foutfile, bool diffmt)
@@ -526,28 +1038,13 @@ putdftext (struct delta const *delta, struct fro *finfile,
   struct diffcmd dc;
 
   fout = foutfile;
-  aprintf (fout, "\n\n%s\n%s\n", delta->num, TINYKS (log));
-
-  /* Put log.  */
-  putstring (fout, true, delta->pretty_log, true);
-  aputc ('\n', fout);
-  /* Put text.  */
-  aprintf (fout, "%s\n%c", TINYKS (text), SDELIM);
+  begin_dtext (delta, fout);
 
   fin = finfile;
   if (!diffmt)
     {
       /* Copy the file.  */
-      for (;;)
-        {
-          GETCHAR_OR (c, fin, goto done);
-          if (c == SDELIM)
-            /* Double up ‘SDELIM’.  */
-            aputc (SDELIM, fout);
-          aputc (c, fout);
-        }
-    done:
-      ;
+      fro_spew_stuffed (fin, fout);
     }
   else
     {
@@ -575,4 +1072,18 @@ putdftext (struct delta const *delta, struct fro *finfile,
   aprintf (fout, "%c\n", SDELIM);
 }
 
+void
+putddtext (struct delta const *delta, struct fro *from, struct fro *to,
+           FILE *fout)
+/* Like ‘putdftext’, except the text is the "diff -n" edit script
+   that turns ‘from’ into ‘to’, computed without running diff(1).  */
+{
+  struct divvy *space = make_space ("putddtext");
+
+  begin_dtext (delta, fout);
+  diff_stuffed (fout, fro_contents (space, from), fro_contents (space, to));
+  aprintf (fout, "%c\n", SDELIM);
+  close_space (space);
+}
+
 /* rcsgen.c ends here */
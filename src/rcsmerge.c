@@ -25,12 +25,10 @@
 #include "rcsmerge.help"
 #include "b-complain.h"
 #include "b-divvy.h"
+#include "b-fb.h"
 #include "b-feph.h"
 #include "b-fro.h"
 #include "b-merger.h"
-#include "b-peer.h"
-
-#define quietarg  "-q"
 
 int
 rcsmerge_main (const char *cmd, int argc, char **argv)
@@ -39,11 +37,12 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
   char *a, **newargv;
   struct symdef three_manifestations[3];
   char const *rev[3];                   /*revision numbers */
-  char const *edarg, *expandarg, *suffixarg, *versionarg, *zonearg;
+  char const *edarg, *expandarg;
   bool tostdout;
   int status, exitstatus;
   struct fro *workptr;
-  struct delta *target;
+  struct delta *target, *t[2];
+  FILE *out[2];
   const struct program program =
     {
       .invoke = argv[0],
@@ -58,7 +57,7 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
   edarg = rev[1] = rev[2] = NULL;
   status = 0;                           /* Keep lint happy.  */
   tostdout = false;
-  expandarg = suffixarg = versionarg = zonearg = quietarg;      /* no-op */
+  expandarg = NULL;
   BE (pe) = X_DEFAULT;
 
   argc = getRCSINIT (argc, argv, &newargv);
@@ -95,11 +94,9 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
           break;
 
         case 'x':
-          suffixarg = *argv;
           BE (pe) = a;
           break;
         case 'z':
-          zonearg = *argv;
           zone_set (a);
           break;
         case 'T':
@@ -108,8 +105,7 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
             goto unknown;
           break;
         case 'V':
-          versionarg = *argv;
-          setRCSversion (versionarg);
+          setRCSversion (*argv);
           break;
 
         case 'k':
@@ -154,13 +150,13 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
           if (!*rev[1])
             rev[1] = defbr ? defbr : tip->num;
           if (fully_numeric (&numericrev, rev[1], workptr)
-              && (target = delta_from_ref (numericrev.string)))
+              && (target = t[0] = delta_from_ref (numericrev.string)))
             {
               LABEL (1) = target->num;
               if (!rev[2] || !*rev[2])
                 rev[2] = defbr ? defbr : tip->num;
               if (fully_numeric (&numericrev, rev[2], workptr)
-                  && (target = delta_from_ref (numericrev.string)))
+                  && (target = t[1] = delta_from_ref (numericrev.string)))
                 {
                   LABEL (2) = target->num;
 
@@ -169,25 +165,30 @@ rcsmerge_main (const char *cmd, int argc, char **argv)
                       if (tostdout)
                         {
                           fro_spew (workptr, stdout);
-                          fclose (stdout);
+                          fflush (stdout);
                         }
                     }
                   else
                     {
                       fro_zclose (&workptr);
 
+                      /* Build both revisions as "co -q -pREV" would,
+                         but in-process and in one pass.  */
+                      if (expandarg)
+                        BE (kws) = str2expmode (expandarg + 2);
                       for (i = 1; i <= 2; i++)
                         {
-                          struct cbuf commarg = minus_p (LABEL (i), rev[i]);
-
-                          if (run (-1,
-                                   /* Don't collide with merger.c ‘maketemp’.  */
-                                   FNAME (i) = maketemp (i + 2),
-                                   PEER_SUPER (), "co", quietarg, commarg.string,
-                                   expandarg, suffixarg, versionarg, zonearg,
-                                   repo_filename, NULL))
-                            RFATAL ("co failed");
+                          diagnose ("retrieving revision %s", LABEL (i));
+                          t[i - 1]->name = namedrev (rev[i], t[i - 1]);
+                          /* Don't collide with merger.c ‘maketemp’.  */
+                          FNAME (i) = maketemp (i + 2);
+                          if (!(out[i - 1] = fopen_safer (FNAME (i),
+                                                          FOPEN_W_WORK)))
+                            fatal_sys (FNAME (i));
                         }
+                      buildrevisions (2, t, out, BE (kws) < MIN_UNEXPAND);
+                      Ozclose (&out[0]);
+                      Ozclose (&out[1]);
                       diagnose
                         ("Merging differences between %s and %s into %s%s",
                          LABEL (1), LABEL (2), mani_filename,
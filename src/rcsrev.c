@@ -23,9 +23,11 @@
 #include "base.h"
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include "b-complain.h"
 #include "b-divvy.h"
 #include "b-esds.h"
+#include "b-grok.h"
 
 static int
 split (char const *s, char const **lastdot)
@@ -297,6 +299,84 @@ compartial (char const *num1, char const *num2, int length)
     }
 }
 
+struct revtuple *
+make_revtuple (struct divvy *to, char const *num)
+/* Return a new tuple in ‘to’ holding the fields of ‘num’, or NULL if
+   ‘num’ is NULL, has a non-digit in it, or has a field too large for
+   ‘unsigned long’.  As with ‘cmpnum’, an empty field counts as zero.  */
+{
+  struct revtuple *rt;
+  unsigned long *f;
+  size_t count;
+
+  if (!num)
+    return NULL;
+  count = countnumflds (num);
+  rt = alloc (to, "revtuple",
+              sizeof (struct revtuple) + count * sizeof (unsigned long));
+  rt->count = count;
+  f = rt->field;
+  if (count)
+    *f = 0;
+  for (char const *s = num; *s; s++)
+    if ('.' == *s)
+      *++f = 0;
+    else if (!isdigit (*s) || (ULONG_MAX - 9) / 10 < *f)
+      return NULL;
+    else
+      *f = 10 * *f + (*s - '0');
+  return rt;
+}
+
+int
+cmptuple (struct revtuple const *a, struct revtuple const *b,
+          size_t length)
+/* Compare the first ‘length’ fields of ‘a’ and ‘b’ like ‘compartial’,
+   or all fields like ‘cmpnum’ if ‘length’ is zero.  Either way,
+   the shorter tuple (the one with an omitted field) is larger.  */
+{
+  for (size_t i = 0;; i++)
+    {
+      if (i == a->count)
+        return length || i < b->count;
+      if (i == b->count)
+        return -1;
+      if (a->field[i] != b->field[i])
+        return a->field[i] < b->field[i] ? -1 : 1;
+      if (length && !--length)
+        return 0;
+    }
+}
+
+int
+cmpdelta (struct delta const *a, struct delta const *b)
+/* Compare the revision numbers of ‘a’ and ‘b’ like ‘cmpnum’.  */
+{
+  return a->tuple && b->tuple
+    ? cmptuple (a->tuple, b->tuple, 0)
+    : cmpnum (a->num, b->num);
+}
+
+static int
+numfld (struct revtuple const *rt, char const *revno,
+        struct delta const *d, int fld)
+/* Return ‘cmpnumfld (revno, d->num, fld)’, using ‘rt’ (the tuple
+   for ‘revno’, or NULL) and ‘d->tuple’ if possible.  */
+{
+  if (rt && d->tuple
+      && (size_t) fld <= rt->count
+      && (size_t) fld <= d->tuple->count)
+    {
+      unsigned long a = rt->field[fld - 1], b = d->tuple->field[fld - 1];
+
+      return a < b ? -1 : a != b;
+    }
+  return cmpnumfld (revno, d->num, fld);
+}
+
+#define FLD_LT(nf,d)  (0 >  numfld (rt, revno, d, nf))
+#define FLD_EQ(nf,d)  (0 == numfld (rt, revno, d, nf))
+
 static void
 store1 (struct wlink ***store, struct delta *next)
 /* Allocate a new list node that addresses ‘next’.
@@ -315,9 +395,74 @@ store1 (struct wlink ***store, struct delta *next)
 #define STORE_MAYBE(x)  if (store) store1 (&store, x)
 #define CLEAR_MAYBE()   if (store) *store = NULL
 
+static size_t
+prefix_len (char const *revno, int field)
+/* Return the length of the first ‘field’ fields of ‘revno’.  */
+{
+  char const *p = revno;
+
+  while (*p && (*p != '.' || --field))
+    p++;
+  return p - revno;
+}
+
+static struct delta *
+indexed (char const *revno, struct wlink **store)
+/* Like ‘genrevs’ with no date, author or state, but consult the
+   revision index (see ‘grok_delta’) instead of comparing numbers.
+   Return NULL if ‘revno’ is not in the index, or the tree no longer
+   leads to it; the caller should then fall back to ‘genrevs’.  */
+{
+  struct delta *target, *d;
+  int length, field;
+
+  if (!(target = grok_delta (REPO (r), revno)))
+    return NULL;
+  if (!store)
+    return target;
+
+  /* Walk down the trunk, then along each branch, to the revision
+     whose number is a prefix of ‘revno’.  The parser guarantees that
+     branches begin with their branch point revision, so a byte
+     comparison suffices.  */
+  length = countnumflds (revno);
+  d = REPO (tip);
+  for (field = 2;; field += 2)
+    {
+      size_t len = prefix_len (revno, field);
+      struct wlink *ls;
+
+      while (d && (strncmp (revno, d->num, len) || d->num[len]))
+        {
+          STORE_MAYBE (d);
+          d = d->ilk;
+        }
+      if (!d)
+        return NULL;
+      STORE_MAYBE (d);
+      if (length == field)
+        break;
+
+      /* Find the branch head.  */
+      len = prefix_len (revno, 1 + field);
+      for (ls = d->branches; ls; ls = ls->next)
+        {
+          struct delta *b = ls->entry;
+
+          if (!strncmp (revno, b->num, len) && '.' == b->num[len])
+            break;
+        }
+      if (!ls)
+        return NULL;
+      d = ls->entry;
+    }
+  CLEAR_MAYBE ();
+  return d == target ? d : NULL;
+}
+
 static struct delta *
 genbranch (struct delta const *bpoint, char const *revno,
-           int length, char const *date, char const *author,
+           struct revtuple const *rt, int length, char const *date, char const *author,
            char const *state, struct wlink **store)
 /* Given a branchpoint, a revision number, date, author, and state, find the
    deltas necessary to reconstruct the given revision from the branch point
@@ -344,7 +489,7 @@ genbranch (struct delta const *bpoint, char const *revno,
 
       /* Find branch head.  Branches are arranged in increasing order.  */
       while (d = bhead->entry,
-             0 < (result = cmpnumfld (revno, d->num, field)))
+             0 < (result = numfld (rt, revno, d, field)))
         {
           bhead = bhead->next;
           if (!bhead)
@@ -396,7 +541,7 @@ genbranch (struct delta const *bpoint, char const *revno,
         }
 
       /* Length > field.  Find revision.  Check low.  */
-      if (NUMF_LT (1 + field, revno, d->num))
+      if (FLD_LT (1 + field, d))
         {
           RERR ("%s %s too low", ks_revno, TAKE (field + 1, revno));
           return NULL;
@@ -407,11 +552,11 @@ genbranch (struct delta const *bpoint, char const *revno,
           trail = d;
           d = d->ilk;
         }
-      while (d && !NUMF_LT (1 + field, revno, d->num));
+      while (d && !FLD_LT (1 + field, d));
 
       if ((length > field + 1)
           /* Need exact hit.  */
-          && !NUMF_EQ (1 + field, revno, trail->num))
+          && !FLD_EQ (1 + field, trail))
         {
           absent (revno, field + 1);
           return NULL;
@@ -454,6 +599,7 @@ genrevs (char const *revno, char const *date, char const *author,
 {
   int length;
   register struct delta *d;
+  struct revtuple const *rt;
   int result;
   char const *branchnum;
   char datebuf[datesize + zonelenmax];
@@ -464,12 +610,18 @@ genrevs (char const *revno, char const *date, char const *author,
       goto norev;
     }
 
+  if (!date && !author && !state
+      && (d = indexed (revno, store)))
+    return d;
+  d = REPO (tip);
+  rt = make_revtuple (SINGLE, revno);
+
   length = countnumflds (revno);
 
   if (length >= 1)
     {
       /* At least one field; find branch exactly.  */
-      while ((result = cmpnumfld (revno, d->num, 1)) < 0)
+      while ((result = numfld (rt, revno, d, 1)) < 0)
         {
           STORE_MAYBE (d);
           d = d->ilk;
@@ -490,8 +642,9 @@ genrevs (char const *revno, char const *date, char const *author,
     {
       /* Pick latest one on given branch.  */
       branchnum = d->num;               /* works even for empty revno */
+      rt = d->tuple;
       while (d
-             && NUMF_EQ (1, branchnum, d->num)
+             && 0 == numfld (rt, branchnum, d, 1)
              && ((date && DATE_LT (date, d->date))
                  || (author && STR_DIFF (author, d->author))
                  || (state && STR_DIFF (state, d->state))))
@@ -499,7 +652,7 @@ genrevs (char const *revno, char const *date, char const *author,
           STORE_MAYBE (d);
           d = d->ilk;
         }
-      if (!d || !NUMF_EQ (1, branchnum, d->num)) /* overshot */
+      if (!d || numfld (rt, branchnum, d, 1)) /* overshot */
         {
           cantfindbranch (length ? revno : TAKE (1, branchnum),
                           date, author, state);
@@ -514,8 +667,8 @@ genrevs (char const *revno, char const *date, char const *author,
     }
 
   /* Length >= 2.  Find revision; may go low if ‘length == 2’.  */
-  while ((result = cmpnumfld (revno, d->num, 2)) < 0
-         && (NUMF_EQ (1, revno, d->num)))
+  while ((result = numfld (rt, revno, d, 2)) < 0
+         && (FLD_EQ (1, d)))
     {
       STORE_MAYBE (d);
       d = d->ilk;
@@ -523,7 +676,7 @@ genrevs (char const *revno, char const *date, char const *author,
         break;
     }
 
-  if (!d || !NUMF_EQ (1, revno, d->num))
+  if (!d || !FLD_EQ (1, d))
     {
       RERR ("%s %s too low", ks_revno, TAKE (2, revno));
       goto norev;
@@ -538,7 +691,7 @@ genrevs (char const *revno, char const *date, char const *author,
   STORE_MAYBE (d);
 
   if (length > 2)
-    return genbranch (d, revno, length, date, author, state, store);
+    return genbranch (d, revno, rt, length, date, author, state, store);
   else
     {                                   /* length == 2 */
       if (date && DATE_LT (date, d->date))
@@ -568,6 +721,8 @@ norev:
 
 #undef CLEAR_MAYBE
 #undef STORE_MAYBE
+#undef FLD_EQ
+#undef FLD_LT
 
 struct delta *
 gr_revno (char const *revno, struct wlink **store)
@@ -587,25 +742,18 @@ delta_from_ref (char const *ref)
 
 static char const *
 rev_from_symbol (struct cbuf const *id)
-/* Look up ‘id’ in the list of symbolic names starting with pointer
-   ‘GROK (symbols)’, and return a pointer to the corresponding
-   revision number.  Return NULL if not present.  */
+/* Look up ‘id’ among the symbolic names of ‘REPO (r)’, and return
+   a pointer to the corresponding revision number.  Return NULL if
+   not present.  */
 {
-  for (struct link *ls = GROK (symbols); ls; ls = ls->next)
-    {
-      struct symdef const *d = ls->entry;
+  struct symdef const *d = grok_symbol (REPO (r), id->string, id->size);
 
-      if (!strncmp (d->meaningful, id->string, id->size))
-        return d->underlying;
-    }
-  return NULL;
+  return d ? d->underlying : NULL;
 }
 
 static char const *
 lookupsym (char const *id)
-/* Look up ‘id’ in the list of symbolic names starting with pointer
-   ‘GROK (symbols)’, and return a pointer to the corresponding
-   revision number.  Return NULL if not present.  */
+/* Like ‘rev_from_symbol’, for NUL-terminated ‘id’.  */
 {
   struct cbuf identifier =
     {
@@ -36,9 +36,11 @@
 #include "b-fb.h"
 #include "b-feph.h"
 #include "b-isr.h"
+#include "b-jobs.h"
 #include "gnu-h-v.h"
 #include "maketime.h"
 #include "progname.h"
+#include "timespec.h"
 
 /* Unfortunately, using ‘_Exit’ makes coverage analysis
    (via ‘gcc --coverage’) difficult since the coverage
@@ -57,18 +59,41 @@ exit_diff_trouble (void)
   _Exit (DIFF_TROUBLE);
 }
 
+THREAD_LOCAL struct bail_out *bail_out;
+
+static void
+maybe_bail_out (int exitval)
+{
+  if (bail_out)
+    {
+      bail_out->exitval = exitval;
+      longjmp (bail_out->where, 1);
+    }
+}
+
 exiting void
 thank_you_and_goodnight (int const how)
 {
+  int exitval = (how & TYAG_DIFF)
+    ? DIFF_FAILURE
+    : EXIT_FAILURE;
+
   if (how & TYAG_ORCSERROR)
     ORCSerror ();
   if (how & TYAG_DIRTMPUNLINK)
     dirtempunlink ();
   if (how & TYAG_TEMPUNLINK)
     tempunlink ();
-  _Exit ((how & TYAG_DIFF)
-         ? DIFF_FAILURE
-         : EXIT_FAILURE);
+  maybe_bail_out (exitval);
+  _Exit (jobs_fatal (exitval));
+}
+
+exiting void
+gnurcs_exit (int exitval)
+/* Like ‘exit’, but honor ‘bail_out’.  */
+{
+  maybe_bail_out (exitval);
+  exit (exitval);
 }
 
 void
@@ -105,11 +130,77 @@ gnurcs_init (struct program const *program)
       /* Default value.  */
       : 256;
   }
+
+  /* Set ‘BE (grok_cache)’.  */
+  {
+    char *v = getenv ("RCS_GROK_CACHE");
+
+    /* Silently ignore empty value.  */
+    BE (grok_cache) = v && v[0]
+      ? str_save (v)
+      : NULL;
+  }
+
+  /* Set ‘BE (rev_cache)’ and ‘BE (rev_cache_size)’.  */
+  {
+    char *v = getenv ("RCS_CACHE_DIR");
+    long lim;
+
+    /* Silently ignore empty value.  */
+    BE (rev_cache) = v && v[0]
+      ? str_save (v)
+      : NULL;
+    BE (rev_cache_size) = ((v = getenv ("RCS_CACHE_SIZE"))
+                           && v[0])
+      /* Clamp user-specified value to [0,LONG_MAX].  */
+      ? (0 > (lim = strtol (v, NULL, 10))
+         ? 0
+         : lim)
+      /* Default value.  */
+      : 65536;
+  }
+
+  /* Set ‘BE (external_diff)’.  */
+  {
+    char *v = getenv ("RCS_EXTERNAL_DIFF");
+
+    /* Silently ignore empty value.  */
+    BE (external_diff) = v && v[0];
+  }
+
+  /* Set ‘BE (jobs)’.  */
+  {
+    char *v = getenv ("RCS_JOBS");
+    long lim;
+
+    BE (jobs) = (v && v[0])
+      /* Zero means one per processor.  */
+      ? (0 < (lim = strtol (v, NULL, 10))
+         ? lim
+         : (0 == lim && 0 < (lim = sysconf (_SC_NPROCESSORS_ONLN))
+            ? lim
+            : 1))
+      /* Default value.  */
+      : 1;
+  }
+
+  /* Set ‘BE (trace)’.  */
+  {
+    char *v = getenv ("RCS_TRACE");
+
+    /* Silently ignore empty value.  */
+    BE (trace) = v && v[0];
+  }
 }
 
 void
 gnurcs_goodbye (void)
 {
+  if (BE (trace) && BE (children))
+    complain ("%s: trace: %lu fork/exec, %ld.%03lds in children\n",
+              PROGRAM (name), BE (children),
+              BE (children_msecs) / 1000, BE (children_msecs) % 1000);
+
   /* Whatever globals ‘gnurcs_init’ sets, we must reset.  */
   top = NULL;
   close_space (SINGLE); SINGLE = NULL;
@@ -117,27 +208,33 @@ gnurcs_goodbye (void)
 }
 
 void
-bad_option (char const *option)
+droot_global_to_stack (struct dynamic_root *dr)
+/* Save the per-thread state in ‘dr’.  */
 {
-  PERR ("unknown option: %s", option);
+  dr->top = top;
+  dr->single = single;
+  dr->plexus = plexus;
 }
 
 void
-redefined (int c)
+droot_stack_to_global (struct dynamic_root *dr)
+/* Restore the per-thread state saved in ‘dr’.  */
 {
-  PWARN ("redefinition of -%c option", c);
+  top = dr->top;
+  single = dr->single;
+  plexus = dr->plexus;
 }
 
-struct cbuf
-minus_p (char const *xrev, char const *rev)
+void
+bad_option (char const *option)
 {
-  struct cbuf rv;
+  PERR ("unknown option: %s", option);
+}
 
-  diagnose ("retrieving revision %s", xrev);
-  /* Not ‘xrev’, for $Name's sake.  */
-  accf (SINGLE, "-p%s", rev);
-  rv.string = finish_string (SINGLE, &rv.size);
-  return rv;
+void
+redefined (int c)
+{
+  PWARN ("redefinition of -%c option", c);
 }
 
 void
@@ -298,15 +395,25 @@ accumulate_arg_quoted (struct divvy *space, int c, register char const *s)
 #define EXECV  execvp
 #endif
 
-int
-runv (int infd, char const *outname, char const **args)
-/* Run a command.
+static long
+msecs_since (struct timespec const *start)
+{
+  struct timespec now;
+
+  gettime (&now);
+  return 1000 * (now.tv_sec - start->tv_sec)
+    + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+void
+spawn (struct child *kid, int infd, char const *outname, char const **args)
+/* Start a command, recording it in ‘kid’ for ‘reap_child’.
    ‘infd’, if not -1, is the input file descriptor.
    ‘outname’, if non-NULL, is the name of the output file.
-   ‘args[1..]’ form the command to be run; ‘args[0]’ might be modified.  */
+   ‘args[1..]’ form the command to be run; ‘args[0]’ might be modified.
+   On return, the child no longer refers to ‘args’, so the caller
+   can reuse it to start another command before reaping this one.  */
 {
-  int wstatus;
-
   if (!BE (fixed_SIGCHLD))
     {
       BE (fixed_SIGCHLD) = true;
@@ -314,6 +421,9 @@ runv (int infd, char const *outname, char const **args)
     }
 
   oflush ();
+  kid->name = args[1];
+  gettime (&kid->start);
+  BE (children)++;
   {
 #if defined HAVE_WORKING_FORK
     pid_t pid;
@@ -355,14 +465,15 @@ runv (int infd, char const *outname, char const **args)
       }
     if (PROB (pid))
       fatal_sys ("fork");
-    if (PROB (waitpid (pid, &wstatus, 0)))
-      fatal_sys ("waitpid");
+    kid->pid = pid;
 #else   /* !defined HAVE_WORKING_FORK */
     size_t len;
     char *cmd;
     char const **p;
 
-    /* Use ‘system’.  On many hosts ‘system’ discards signals.  Yuck!  */
+    /* Use ‘system’.  On many hosts ‘system’ discards signals.  Yuck!
+       The command runs to completion here; ‘reap_child’ only
+       reports its status.  */
     p = args + 1;
     accs (PLEXUS, *p);
     while (*++p)
@@ -371,22 +482,60 @@ runv (int infd, char const *outname, char const **args)
       accf (PLEXUS, "<&%d", infd);
     if (outname)
       accumulate_arg_quoted (PLEXUS, '>', outname);
-    wstatus = system (cmd = finish_string (PLEXUS, &len));
+    kid->pid = -1;
+    kid->wstatus = system (cmd = finish_string (PLEXUS, &len));
     brush_off (PLEXUS, cmd);
 #endif  /* !defined HAVE_WORKING_FORK */
   }
+}
+
+int
+reap_child (struct child *kid)
+/* Wait for the command started by ‘spawn’ in ‘kid’ to finish,
+   and return its exit status.  */
+{
+  int wstatus;
+
+#if defined HAVE_WORKING_FORK
+  if (PROB (waitpid (kid->pid, &wstatus, 0)))
+    fatal_sys ("waitpid");
+#else
+  wstatus = kid->wstatus;
+#endif
+  if (BE (trace))
+    {
+      long ms = msecs_since (&kid->start);
+
+      BE (children_msecs) += ms;
+      complain ("%s: trace: %s (pid %ld) %s %d, %ld.%03lds\n",
+                PROGRAM (name), kid->name, (long) kid->pid,
+                WIFEXITED (wstatus) ? "exit" : "status",
+                WIFEXITED (wstatus) ? WEXITSTATUS (wstatus) : wstatus,
+                ms / 1000, ms % 1000);
+    }
   if (!WIFEXITED (wstatus))
     {
       if (WIFSIGNALED (wstatus))
         {
-          complain_signal (args[1], WTERMSIG (wstatus));
-          PFATAL ("%s got a fatal signal", args[1]);
+          complain_signal (kid->name, WTERMSIG (wstatus));
+          PFATAL ("%s got a fatal signal", kid->name);
         }
-      PFATAL ("%s failed for unknown reason", args[1]);
+      PFATAL ("%s failed for unknown reason", kid->name);
     }
   return WEXITSTATUS (wstatus);
 }
 
+int
+runv (int infd, char const *outname, char const **args)
+/* Run a command and wait for it to finish; return its exit status.
+   See ‘spawn’ for the meaning of the arguments.  */
+{
+  struct child kid;
+
+  spawn (&kid, infd, outname, args);
+  return reap_child (&kid);
+}
+
 #define CARGSMAX 20
 int
 run (int infd, char const *outname, ...)
@@ -432,7 +581,7 @@ setRCSversion (char const *str)
   else
     {
       display_version (top->program);   /* TODO:ZONK */
-      exit (EXIT_SUCCESS);
+      gnurcs_exit (EXIT_SUCCESS);
     }
 }
 
@@ -32,12 +32,14 @@
 #include "b-excwho.h"
 #include "b-fb.h"
 #include "b-fro.h"
+#include "b-jobs.h"
 
 struct revrange
 {
   char const *beg;
   char const *end;
   int nfield;
+  struct revtuple const *tbeg, *tend;
 };
 
 struct daterange
@@ -286,9 +288,16 @@ extractdelta (struct delta const *pdelta, bool lockflag,
       struct revrange const *rr = ls->entry;
 
       length = rr->nfield;
-      if (countnumflds (pdelta->num) == length + ODDP (length)
-          && 0 <= compartial (pdelta->num, rr->beg, length)
-          && 0 <= compartial (rr->end, pdelta->num, length))
+      if (pdelta->tuple && rr->tbeg && rr->tend)
+        {
+          if (pdelta->tuple->count == (size_t) (length + ODDP (length))
+              && 0 <= cmptuple (pdelta->tuple, rr->tbeg, length)
+              && 0 <= cmptuple (rr->tend, pdelta->tuple, length))
+            break;
+        }
+      else if (countnumflds (pdelta->num) == length + ODDP (length)
+               && 0 <= compartial (pdelta->num, rr->beg, length)
+               && 0 <= compartial (rr->end, pdelta->num, length))
         break;
       if (! (ls = ls->next))
         return false;
@@ -687,6 +696,8 @@ getnumericrev (bool branchflag, struct criteria *criteria)
           rr->nfield = n;
           rr->beg = rstart->string;
           rr->end = rend->string;
+          rr->tbeg = make_revtuple (SINGLE, rr->beg);
+          rr->tend = make_revtuple (SINGLE, rr->end);
           PUSH (rr, criteria->actual);
         }
     }
@@ -698,6 +709,7 @@ getnumericrev (bool branchflag, struct criteria *criteria)
         ? defbr
         : TAKE (1, tip->num);
       rr->nfield = countnumflds (rr->beg);
+      rr->tbeg = rr->tend = make_revtuple (SINGLE, rr->beg);
       PUSH (rr, criteria->actual);
     }
 
@@ -878,7 +890,7 @@ rlog_main (const char *cmd, int argc, char **argv)
     cleanup (&exitstatus);
   else if (argc < 1)
     PFATAL ("no input file");
-  else
+  else if (! jobs_split (&argc, &argv, &exitstatus))
     for (; 0 < argc; cleanup (&exitstatus), ++argv, --argc)
       {
         char const *repo_filename;
@@ -993,7 +1005,8 @@ rlog_main (const char *cmd, int argc, char **argv)
           }
         aputs (equal_line, out);
       }
-  Ozclose (&out);
+  aflush (out);
+  jobs_done (exitstatus);
   gnurcs_goodbye ();
   return exitstatus;
 }
@@ -22,48 +22,21 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include "super.help"
 #include "b-divvy.h"
 #include "b-complain.h"
+#include "b-fro.h"
+#include "b-grok.h"
 #include "b-peer.h"
 
-/* {Dynamic Root} TODO: Move into library.
-
-   For the present, internal dispatch (e.g., ‘diff’ calls ‘co’) goes
-   through execve(2), but the plan is to eventually elide that into
-   a function call, at which point dynamic-root support will need to
-   move into the library.  */
-
-struct dynamic_root
-{
-  struct top *top;
-  struct divvy *single;
-  struct divvy *plexus;
-  /* FIXME: What about these?
-     - program_invocation_name
-     - program_invocation_short_name
-     - stderr
-     - stdin
-     - stdout
-     (These are from "nm --defined-only -D grcs".)  */
-};
-
-static void
-droot_global_to_stack (struct dynamic_root *dr)
-{
-  dr->top = top;
-  dr->single = single;
-  dr->plexus = plexus;
-}
-
-static void
-droot_stack_to_global (struct dynamic_root *dr)
-{
-  top = dr->top;
-  single = dr->single;
-  plexus = dr->plexus;
-}
-
 typedef int (submain_t) (const char *cmd, int argc, char **argv);
 
 struct aliases
@@ -164,7 +137,424 @@ display_commands (void)
     }
 }
 
-struct top *top;
+THREAD_LOCAL struct top *top;
+
+static char const *
+simulated_invocation (char *argv0)
+/* Return the name to use as ‘argv[0]’ for a subcommand.  */
+{
+  return one_beyond_last_dir_sep (argv0)
+    ? argv0
+    : str_save (PEER_SUPER ());
+}
+
+static int
+nested (submain_t *sub, char const *cmd, int argc, char **argv)
+/* Call ‘sub’ surrounded by dynamic-root push/pop, catching
+   a fatal error (or other early exit) in it.  Return its
+   exit value.  */
+{
+  struct dynamic_root super;
+  struct bail_out here, *outer = bail_out;
+  int exitval;
+
+  droot_global_to_stack (&super);
+  bail_out = &here;
+  if (setjmp (here.where))
+    {
+      exitval = here.exitval;
+      /* If ‘sub’ got as far as ‘gnurcs_init’, tear down
+         what it left behind (cleanup having been skipped),
+         ignoring errors: open files, including the working file
+         being written, and other output streams.  */
+      if (top && top != super.top)
+        {
+          FILE *work = MANI (newwork), *res = FLOW (res);
+
+          fro_abandon_all ();
+          if (work && stdout != work)
+            fclose (work);
+          if (res && stdout != res && work != res)
+            fclose (res);
+          if (FLOW (rewr))
+            fclose (FLOW (rewr));
+          gnurcs_goodbye ();
+        }
+    }
+  else
+    exitval = sub (cmd, argc, argv);
+  bail_out = outer;
+  droot_stack_to_global (&super);
+  return exitval;
+}
+
+static char *
+next_request (struct divvy *space, FILE *in, bool *eofp)
+/* Read a line from ‘in’ into ‘space’ and return it (sans newline).
+   Set ‘*eofp’ if there is no more input.  */
+{
+  size_t len;
+  int c;
+
+  while (EOF != (c = getc (in)) && '\n' != c)
+    accumulate_byte (space, c);
+  *eofp = EOF == c;
+  return finish_string (space, &len);
+}
+
+static char **
+split_request (struct divvy *space, char *line, int *argc)
+/* Destructively split ‘line’ at whitespace (no quoting) into a
+   NULL-terminated vector of words allocated in ‘space’.
+   Set ‘*argc’ to the number of words and return the vector.  */
+{
+  static char const ws[] = " \t\r";
+  char **argv;
+  char *p;
+  int count = 0;
+
+  for (p = line; *(p += strspn (p, ws)); p += strcspn (p, ws))
+    count++;
+  argv = pointer_array (space, 1 + count);
+  count = 0;
+  for (p = strtok (line, ws); p; p = strtok (NULL, ws))
+    argv[count++] = p;
+  *argc = count;
+  return argv;
+}
+
+static int
+hide_stdin (void)
+/* Point stdin at /dev/null, so that subcommands that read it
+   cannot consume requests.  Return a new fd for the original.  */
+{
+  int orig, fd;
+
+  if (PROB (orig = dup (STDIN_FILENO))
+      || PROB (fd = open ("/dev/null", O_RDONLY))
+      || PROB (dup2 (fd, STDIN_FILENO))
+      || PROB (close (fd)))
+    fatal_sys ("standard input");
+  return orig;
+}
+
+static int
+divert (int fd)
+/* Point ‘fd’ (standard output or standard error) at a new temporary
+   file, and return an fd for it.  This is at the fd level, so that
+   the output of child processes is captured, too.  */
+{
+  FILE *f;
+  int cap;
+
+  fflush (STDOUT_FILENO == fd ? stdout : stderr);
+  if (! (f = tmpfile ())
+      || PROB (cap = dup (fileno (f)))
+      || PROB (dup2 (cap, fd)))
+    fatal_sys ("temporary file");
+  fclose (f);
+  return cap;
+}
+
+static bool
+relay (int to, char const *buf, size_t len)
+/* Write ‘len’ bytes from ‘buf’ to ‘to’.  Return true if successful.  */
+{
+  ssize_t w;
+
+  for (; len; len -= w, buf += w)
+    if (0 >= (w = write (to, buf, len)))
+      {
+        if (PROB (w) && EINTR == errno)
+          w = 0;
+        else
+          return false;
+      }
+  return true;
+}
+
+static bool
+respond (int to, int cap[2], int exitval)
+/* Write to ‘to’ the response for a command that exited with
+   ‘exitval’, and whose standard output and standard error are
+   in ‘cap[0]’ and ‘cap[1]’, respectively.  Return true if
+   successful.  */
+{
+  char buf[BUFSIZ];
+  ssize_t count;
+  off_t size[2];
+
+  for (int i = 0; i < 2; i++)
+    if (PROB (size[i] = lseek (cap[i], 0, SEEK_END))
+        || PROB (lseek (cap[i], 0, SEEK_SET)))
+      fatal_sys ("temporary file");
+  count = snprintf (buf, sizeof buf, "%d %ld %ld\n", exitval,
+                    (long) size[0], (long) size[1]);
+  if (! relay (to, buf, count))
+    return false;
+  for (int i = 0; i < 2; i++)
+    for (; size[i]; size[i] -= count)
+      {
+        if (0 >= (count = read (cap[i], buf,
+                                (size[i] < (off_t) sizeof buf
+                                 ? (size_t) size[i]
+                                 : sizeof buf))))
+          fatal_sys ("temporary file");
+        if (! relay (to, buf, count))
+          return false;
+      }
+  return relay (to, "\n", 1);
+}
+
+static bool
+serve_line (char const *me, struct divvy *space, char *line,
+            int to, int cap[2])
+/* Handle the request ‘line’ (see ‘serve_requests’), using ‘space’
+   for scratch.  Return false if ‘to’ stops accepting responses.  */
+{
+  char **argv;
+  char const *cmd;
+  int argc, exitval;
+  submain_t *sub;
+
+  argv = split_request (space, line, &argc);
+  if (!argc)
+    return true;
+  /* Construct a simulated invocation.  */
+  cmd = argv[0];
+  argv[0] = (char *) me;
+
+  for (int i = 0; i < 2; i++)
+    if (PROB (ftruncate (cap[i], 0))
+        || PROB (lseek (cap[i], 0, SEEK_SET)))
+      fatal_sys ("temporary file");
+  if (! (sub = recognize (cmd)))
+    {
+      PERR ("unrecognized command: %s", cmd);
+      exitval = EXIT_FAILURE;
+    }
+  else
+    exitval = nested (sub, cmd, argc, argv);
+  fflush (stdout);
+  fflush (stderr);
+  return respond (to, cap, exitval);
+}
+
+static void
+serve_requests (char const *me, FILE *in, int to, int cap[2])
+/* Handle requests from ‘in’, one per line, until EOF (or until ‘to’
+   stops accepting responses).  For each non-blank line "COMMAND
+   ARGS...", run the subcommand with its stdout and stderr diverted
+   to ‘cap[0]’ and ‘cap[1]’, and write "EXITVAL OUTSIZE ERRSIZE\n",
+   followed by OUTSIZE bytes of its standard output, ERRSIZE bytes
+   of its standard error and a final newline, to ‘to’.  */
+{
+  struct divvy *space = make_space ("requests");
+  bool eof = false, ok = true;
+
+  while (ok && !eof)
+    {
+      ok = serve_line (me, space, next_request (space, in, &eof), to, cap);
+      forget (space);
+    }
+  close_space (space);
+}
+
+/* How many bytes of parsed RCS files "batch" and "serve" keep
+   in memory.  */
+#define SERVE_GMEMO_LIMIT  (64 * 1024 * 1024)
+
+static void
+batch (char const *me)
+/* Handle requests from stdin, writing responses to stdout.  */
+{
+  FILE *in;
+  int to, err, cap[2];
+
+  if (! (in = fdopen (hide_stdin (), "r"))
+      || PROB (to = dup (STDOUT_FILENO))
+      || PROB (err = dup (STDERR_FILENO)))
+    fatal_sys ("batch");
+  cap[0] = divert (STDOUT_FILENO);
+  cap[1] = divert (STDERR_FILENO);
+  gmemo = make_gmemo (SERVE_GMEMO_LIMIT);
+  serve_requests (me, in, to, cap);
+  fclose (in);
+  close (cap[0]);
+  close (cap[1]);
+  if (PROB (dup2 (err, STDERR_FILENO))
+      || PROB (close (err)))
+    fatal_sys ("standard error");
+  if (PROB (dup2 (to, STDOUT_FILENO))
+      || PROB (close (to)))
+    fatal_sys ("standard output");
+}
+
+/* How many seconds "serve" waits for a client to accept (part of)
+   a response before giving up on it.  */
+#define SERVE_SEND_TIMEOUT  30
+
+/* A connection to "serve", with the input not yet handled.  */
+struct client
+{
+  int fd;
+  bool eof;
+  char *buf;
+  size_t len, size;
+};
+
+static char *
+client_line (struct divvy *space, struct client *c)
+/* If ‘c’ has a complete request line (or, at EOF, any input left),
+   remove it from ‘c->buf’ and return a copy in ‘space’ (sans newline).
+   Otherwise, return NULL.  */
+{
+  char *nl = memchr (c->buf, '\n', c->len);
+  size_t len, used;
+
+  if (!nl && !(c->eof && c->len))
+    return NULL;
+  len = nl ? (size_t) (nl - c->buf) : c->len;
+  used = nl ? 1 + len : len;
+  accumulate_range (space, c->buf, c->buf + len);
+  c->len -= used;
+  memmove (c->buf, c->buf + used, c->len);
+  return finish_string (space, &len);
+}
+
+static void
+client_input (struct client *c)
+/* Read what is available from ‘c->fd’ into ‘c->buf’.
+   At EOF (or on error), set ‘c->eof’.  */
+{
+  ssize_t count;
+
+  if (c->size - c->len < BUFSIZ)
+    c->buf = okalloc (realloc (c->buf, c->size += BUFSIZ));
+  while (PROB (count = read (c->fd, c->buf + c->len, c->size - c->len))
+         && EINTR == errno)
+    continue;
+  if (0 < count)
+    c->len += count;
+  else
+    c->eof = true;
+}
+
+static exiting void
+serve (char const *me, char const *name)
+/* Listen on the Unix-domain socket ‘name’, and handle the requests
+   from each connection as for ‘batch’.  The requests are handled one
+   at a time, but only once they have arrived in full, taking turns
+   among the connections, so that a slow or idle client does not hold
+   up the others.  Never return.  */
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  struct divvy *space;
+  struct client *clients = NULL;
+  struct pollfd *pfd = NULL;
+  size_t count = 0, room = 0;
+  int sock, cap[2];
+  mode_t mask;
+
+  if (strlen (name) >= sizeof (addr.sun_path))
+    PFATAL ("socket name too long: %s", name);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, name);
+  /* Remove a stale socket (but nothing else).  */
+  if (!PROB (lstat (name, &st)) && S_ISSOCK (st.st_mode))
+    unlink (name);
+  if (PROB (sock = socket (AF_UNIX, SOCK_STREAM, 0)))
+    fatal_sys (name);
+  /* Anyone who can connect can run commands as us,
+     so create the socket accessible only to us.  */
+  mask = umask (077);
+  if (PROB (bind (sock, (struct sockaddr *) &addr, sizeof (addr))))
+    fatal_sys (name);
+  umask (mask);
+  if (PROB (listen (sock, SOMAXCONN)))
+    fatal_sys (name);
+
+  close (hide_stdin ());
+  cap[0] = divert (STDOUT_FILENO);
+  cap[1] = divert (STDERR_FILENO);
+  /* A client that goes away should not take the server with it.  */
+  signal (SIGPIPE, SIG_IGN);
+  gmemo = make_gmemo (SERVE_GMEMO_LIMIT);
+  space = make_space ("requests");
+
+  for (;;)
+    {
+      bool pending = false;
+
+      /* Take turns: handle (at most) one request from each client.
+         After EOF, a client is kept until all its input is handled.  */
+      for (size_t i = 0; i < count; i++)
+        {
+          struct client *c = clients + i;
+          char *line = client_line (space, c);
+
+          if (line && ! serve_line (me, space, line, c->fd, cap))
+            c->eof = true, c->len = 0;
+          forget (space);
+          if (c->eof && !c->len)
+            {
+              close (c->fd);
+              free (c->buf);
+              clients[i--] = clients[--count];
+            }
+          else if ((c->eof && c->len) || memchr (c->buf, '\n', c->len))
+            pending = true;
+        }
+
+      if (room < 1 + count)
+        {
+          room = 2 * (1 + count);
+          clients = okalloc (realloc (clients, room * sizeof *clients));
+          pfd = okalloc (realloc (pfd, room * sizeof *pfd));
+        }
+      pfd[0] = (struct pollfd) { .fd = sock, .events = POLLIN };
+      for (size_t i = 0; i < count; i++)
+        pfd[1 + i] = (struct pollfd)
+          {
+            /* Ignore (negative fd) a client already at EOF.  */
+            .fd = clients[i].eof ? -1 : clients[i].fd,
+            .events = POLLIN
+          };
+      if (PROB (poll (pfd, 1 + count, pending ? 0 : -1)))
+        {
+          if (EINTR == errno)
+            continue;
+          fatal_sys ("poll");
+        }
+
+      /* Read what has arrived.  */
+      for (size_t i = 0; i < count; i++)
+        if (pfd[1 + i].revents)
+          client_input (clients + i);
+
+      if (pfd[0].revents & POLLIN)
+        {
+          struct timeval timeout = { .tv_sec = SERVE_SEND_TIMEOUT };
+          int conn = accept (sock, NULL, NULL);
+
+          if (PROB (conn))
+            {
+              if (EINTR != errno && ECONNABORTED != errno)
+                fatal_sys ("accept");
+            }
+          else
+            {
+              /* A client that stops reading should not block the others
+                 (nor the server) indefinitely.  */
+              setsockopt (conn, SOL_SOCKET, SO_SNDTIMEO,
+                          &timeout, sizeof timeout);
+              clients[count++] = (struct client) { .fd = conn };
+            }
+        }
+    }
+}
 
 static char const hint[] = " (try --help)";
 
@@ -209,6 +599,27 @@ main (int argc, char **argv)
           HUH ("option");
         }
 
+      if (STR_SAME ("batch", argv[1]))
+        {
+          if (2 < argc)
+            PFATAL ("unexpected argument: %s%s", argv[2], hint);
+          batch (simulated_invocation (argv[0]));
+          goto done;
+        }
+
+      if (STR_SAME ("serve", argv[1]))
+        {
+          char const *name = NULL;
+
+          if (4 == argc && STR_SAME ("--socket", argv[2]))
+            name = argv[3];
+          else if (3 == argc && !strncmp ("--socket=", argv[2], 9))
+            name = argv[2] + 9;
+          if (!name || !*name)
+            PFATAL ("usage: %s serve --socket NAME", PROGRAM (name));
+          serve (simulated_invocation (argv[0]), name);
+        }
+
       /* Try dispatch.  */
       if (! (sub = recognize (cmd = argv[1])))
         HUH ("command");
@@ -217,9 +628,7 @@ main (int argc, char **argv)
           struct dynamic_root super;
 
           /* Construct a simulated invocation.  */
-          argv[1] = one_beyond_last_dir_sep (argv[0])
-            ? argv[0]
-            : str_save (PEER_SUPER ());
+          argv[1] = (char *) simulated_invocation (argv[0]);
 
           /* Dispatch, surrounded by dynamic-root push/pop.  */
           droot_global_to_stack (&super);
@@ -240,6 +649,18 @@ Options:
   --version    Display version information and exit.
   --commands   Display available commands and exit.
 
+The command "batch" reads commands (e.g., "co -p -r1.2 foo.c,v"),
+one per line, from stdin.  For each, it writes to stdout a line
+"EXITVAL OUTSIZE ERRSIZE", then OUTSIZE bytes of the command's output,
+ERRSIZE bytes of its diagnostics, then a newline.  Arguments are
+separated by whitespace; there is no quoting.  Recently parsed RCS
+files are kept in memory.
+
+The command "serve --socket NAME" listens on the Unix-domain socket
+NAME (accessible only to its owner), and handles requests from each
+connection as for "batch".  Relative file names in requests are
+resolved in the server's working directory, not the client's.
+
 To see help for a command, specify the command and --help, e.g.:
   co --help
 */
@@ -32,7 +32,7 @@
    (to be invoked from the t??? files) for various components of
    the RCS library.  */
 
-struct top *top;
+THREAD_LOCAL struct top *top;
 
 exiting void
 bad_args (char const *argv0)